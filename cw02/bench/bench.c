@@ -0,0 +1,458 @@
+#define _GNU_SOURCE //enable realpath into malloc'd buffer
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define MB (1024 * 1024)
+#define MAX_SIZES 16
+#define MAX_ARGS 8
+
+typedef enum {
+    INTERLEAVE, //zad01: two text files into stdout
+    GREP,       //zad02: lines containing a character into stdout
+    NUMBERS,    //zad03: dane.txt in cwd into a.txt, b.txt, c.txt
+    REPLACE_EQ, //zad04: needle and replacement of equal length
+    REPLACE_NE, //zad04: replacement longer than needle
+    WRAP,       //zad05: wrap at 50 bytes
+    WRAP_UTF8   //zad05: wrap at 50 code points
+} bench_kind;
+
+typedef struct {
+    const char *tool;
+    const char *variant;
+    bench_kind kind;
+    //1 for tools moving a byte per call (their runs are capped with -l), 0 for whole-file mappings
+    size_t buf_size;
+    char binary[PATH_MAX];
+} bench_case;
+
+typedef struct {
+    size_t runs;
+    double mean;
+    double ci95;
+    double best;
+} bench_stats;
+
+bench_case *build_cases(size_t *count);
+bool generate_inputs(const char *data_dir, size_t size);
+bool generate_text(const char *path, size_t size, size_t max_line, uint64_t seed);
+bool generate_numbers(const char *path, size_t size, uint64_t seed);
+size_t build_args(const bench_case *bench, const char *data_dir, size_t size, char args[MAX_ARGS][PATH_MAX], const char **cwd);
+double run_once(const char *binary, char **argv, const char *cwd);
+bench_stats compute_stats(const double *samples, size_t n);
+double student_t95(size_t df);
+uint64_t xorshift64(uint64_t *state);
+
+int main(int argc, char **argv) {
+    const char *sizes_arg = "1,16,256,1024";
+    const char *data_dir_arg = "bench_data";
+    size_t repeats = 5;
+    size_t bytewise_cap = 16;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:r:d:l:")) != -1) {
+        switch (opt) {
+            case 's': sizes_arg = optarg; break;
+            case 'd': data_dir_arg = optarg; break;
+            case 'r':
+                if (sscanf(optarg, "%zu", &repeats) != 1 || repeats == 0) {
+                    fprintf(stderr, "malformed repeat count\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'l':
+                if (sscanf(optarg, "%zu", &bytewise_cap) != 1) {
+                    fprintf(stderr, "malformed size cap\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-s sizes_mb] [-r repeats] [-d data_dir] [-l bytewise_cap_mb]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    size_t sizes[MAX_SIZES];
+    size_t size_count = 0;
+
+    char *sizes_copy = strdup(sizes_arg);
+    char *saveptr;
+    for (char *tok = strtok_r(sizes_copy, ",", &saveptr); tok; tok = strtok_r(NULL, ",", &saveptr)) {
+        if (size_count == MAX_SIZES || sscanf(tok, "%zu", &sizes[size_count]) != 1 || sizes[size_count] == 0) {
+            fprintf(stderr, "malformed size list\n");
+            free(sizes_copy);
+            return EXIT_FAILURE;
+        }
+        size_count++;
+    }
+    free(sizes_copy);
+
+    if (mkdir(data_dir_arg, 0755) == -1 && errno != EEXIST) {
+        perror(data_dir_arg);
+        return EXIT_FAILURE;
+    }
+
+    //zad03 is run from inside the data dir, so everything must be absolute
+    char *data_dir = realpath(data_dir_arg, NULL);
+    if (!data_dir) {
+        perror(data_dir_arg);
+        return EXIT_FAILURE;
+    }
+
+    size_t case_count;
+    bench_case *cases = build_cases(&case_count);
+
+    double *samples = malloc(repeats * sizeof(*samples));
+
+    printf("tool,variant,buf_size,input_bytes,runs,mean_mb_s,ci95_mb_s,best_mb_s\n");
+
+    for (size_t s = 0; s < size_count; s++) {
+        size_t size = sizes[s] * MB;
+
+        fprintf(stderr, "generating %zu MB inputs\n", sizes[s]);
+        if (!generate_inputs(data_dir, size)) {
+            free(samples);
+            free(cases);
+            free(data_dir);
+            return EXIT_FAILURE;
+        }
+
+        for (size_t c = 0; c < case_count; c++) {
+            bench_case *bench = &cases[c];
+
+            if (bench->buf_size == 1 && sizes[s] > bytewise_cap) {
+                fprintf(stderr, "skipping %s/%s at %zu MB, above bytewise cap\n", bench->tool, bench->variant, sizes[s]);
+                continue;
+            }
+
+            char args[MAX_ARGS][PATH_MAX];
+            char *run_argv[MAX_ARGS + 1];
+            const char *cwd = NULL;
+
+            size_t arg_count = build_args(bench, data_dir, size, args, &cwd);
+            for (size_t i = 0; i < arg_count; i++) {
+                run_argv[i] = args[i];
+            }
+            run_argv[arg_count] = NULL;
+
+            //warmup run, also pulls the input into the page cache
+            if (run_once(bench->binary, run_argv, cwd) < 0) {
+                fprintf(stderr, "%s/%s failed\n", bench->tool, bench->variant);
+                continue;
+            }
+
+            size_t runs = 0;
+            for (size_t r = 0; r < repeats; r++) {
+                double elapsed = run_once(bench->binary, run_argv, cwd);
+                if (elapsed > 0) {
+                    samples[runs++] = (double)size / MB / elapsed;
+                }
+            }
+
+            bench_stats stats = compute_stats(samples, runs);
+            printf("%s,%s,%zu,%zu,%zu,%.2f,%.2f,%.2f\n",
+                   bench->tool, bench->variant, bench->buf_size, size,
+                   stats.runs, stats.mean, stats.ci95, stats.best);
+            fflush(stdout);
+        }
+    }
+
+    free(samples);
+    free(cases);
+    free(data_dir);
+}
+
+//every case the Makefile built a binary for, as many as BLOCK_SIZES asks for
+bench_case *build_cases(size_t *case_count) {
+    static const bench_case fixed[] = {
+        { "zad01", "sys", INTERLEAVE, 1 },
+        { "zad01", "lib", INTERLEAVE, 1 },
+        { "zad01", "thr", INTERLEAVE, 1 << 20 },
+        { "zad02", "sys", GREP, 1 },
+        { "zad02", "lib", GREP, 1 },
+        { "zad03", "sys", NUMBERS, 1 },
+        { "zad03", "lib", NUMBERS, 1 },
+        { "zad04", "sys", REPLACE_EQ, 1 },
+        { "zad04", "lib", REPLACE_EQ, 1 },
+        { "zad04", "mmap", REPLACE_EQ, 0 },
+        { "zad04", "sys", REPLACE_NE, 1 },
+        { "zad04", "lib", REPLACE_NE, 1 },
+        { "zad04", "mmap", REPLACE_NE, 0 }
+    };
+
+    //zad05 is built once per block size, see BLOCK_SIZES in the Makefile
+    static const char *variants[] = { "sys", "lib" };
+    size_t per_block_size = 2 * (WRAP_UTF8 - WRAP + 1);
+    size_t block_size_count = 0;
+
+    char *block_sizes = strdup(BLOCK_SIZES);
+    char *saveptr;
+    for (char *tok = strtok_r(block_sizes, " ", &saveptr); tok; tok = strtok_r(NULL, " ", &saveptr)) {
+        block_size_count++;
+    }
+    free(block_sizes);
+
+    bench_case *cases = calloc(sizeof(fixed) / sizeof(*fixed) + block_size_count * per_block_size, sizeof(*cases));
+    size_t count = 0;
+
+    for (size_t i = 0; i < sizeof(fixed) / sizeof(*fixed); i++) {
+        cases[count] = fixed[i];
+        snprintf(cases[count].binary, sizeof(cases[count].binary), "./%s_%s", fixed[i].tool, fixed[i].variant);
+        count++;
+    }
+
+    block_sizes = strdup(BLOCK_SIZES);
+    for (char *tok = strtok_r(block_sizes, " ", &saveptr); tok; tok = strtok_r(NULL, " ", &saveptr)) {
+        for (size_t v = 0; v < 2; v++) {
+            for (bench_kind kind = WRAP; kind <= WRAP_UTF8; kind++) {
+                bench_case *bench = &cases[count++];
+
+                bench->tool = "zad05";
+                bench->variant = kind == WRAP ? variants[v] : (v == 0 ? "sys_utf8" : "lib_utf8");
+                bench->kind = kind;
+                bench->buf_size = strtoul(tok, NULL, 10);
+                snprintf(bench->binary, sizeof(bench->binary), "./zad05_%s_%s", variants[v], tok);
+            }
+        }
+    }
+    free(block_sizes);
+
+    //binaries get exec'd from other working directories
+    for (size_t i = 0; i < count; i++) {
+        char *binary = realpath(cases[i].binary, NULL);
+        if (binary) {
+            snprintf(cases[i].binary, sizeof(cases[i].binary), "%s", binary);
+            free(binary);
+        }
+    }
+
+    *case_count = count;
+    return cases;
+}
+
+bool generate_inputs(const char *data_dir, size_t size) {
+    char path[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/text_%zu_a.txt", data_dir, size);
+    if (!generate_text(path, size / 2, 200, size + 1)) return false;
+
+    snprintf(path, sizeof(path), "%s/text_%zu_b.txt", data_dir, size);
+    if (!generate_text(path, size - size / 2, 200, size + 2)) return false;
+
+    snprintf(path, sizeof(path), "%s/text_%zu.txt", data_dir, size);
+    if (!generate_text(path, size, 200, size + 3)) return false;
+
+    snprintf(path, sizeof(path), "%s/long_%zu.txt", data_dir, size);
+    if (!generate_text(path, size, 1000, size + 4)) return false;
+
+    snprintf(path, sizeof(path), "%s/numbers_%zu", data_dir, size);
+    if (mkdir(path, 0755) == -1 && errno != EEXIST) {
+        perror(path);
+        return false;
+    }
+
+    snprintf(path, sizeof(path), "%s/numbers_%zu/dane.txt", data_dir, size);
+    return generate_numbers(path, size, size + 5);
+}
+
+/**
+ * lines of random length up to max_line, drawn from a small alphabet
+ * so that the needles used for zad02 and zad04 occur often
+ */
+bool generate_text(const char *path, size_t size, size_t max_line, uint64_t seed) {
+    struct stat st;
+    if (stat(path, &st) == 0 && (size_t)st.st_size == size) {
+        return true;
+    }
+
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        perror(path);
+        return false;
+    }
+
+    static const char alphabet[] = "ABCDabcd ";
+    size_t line_left = 0;
+
+    for (size_t i = 0; i < size; i++) {
+        if (line_left == 0) {
+            line_left = xorshift64(&seed) % max_line + 1;
+        }
+
+        line_left--;
+        fputc(line_left == 0 || i == size - 1 ? '\n' : alphabet[xorshift64(&seed) % (sizeof(alphabet) - 1)], file);
+    }
+
+    fclose(file);
+    return true;
+}
+
+bool generate_numbers(const char *path, size_t size, uint64_t seed) {
+    struct stat st;
+    if (stat(path, &st) == 0 && (size_t)st.st_size >= size) {
+        return true;
+    }
+
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        perror(path);
+        return false;
+    }
+
+    size_t written = 0;
+    while (written < size) {
+        long long n = (long long)(xorshift64(&seed) % 2000000000001ULL) - 1000000000000LL;
+
+        //keep some perfect squares around for c.txt
+        if (n % 16 == 0) {
+            long long root = llabs(n) % 1000000;
+            n = root * root;
+        }
+
+        written += fprintf(file, "%lld\n", n);
+    }
+
+    fclose(file);
+    return true;
+}
+
+size_t build_args(const bench_case *bench, const char *data_dir, size_t size, char args[MAX_ARGS][PATH_MAX], const char **cwd) {
+    static char numbers_dir[PATH_MAX];
+    size_t n = 0;
+
+    snprintf(args[n++], PATH_MAX, "%s", bench->binary);
+
+    switch (bench->kind) {
+        case INTERLEAVE:
+            snprintf(args[n++], PATH_MAX, "%s/text_%zu_a.txt", data_dir, size);
+            snprintf(args[n++], PATH_MAX, "%s/text_%zu_b.txt", data_dir, size);
+            break;
+        case GREP:
+            snprintf(args[n++], PATH_MAX, "D");
+            snprintf(args[n++], PATH_MAX, "%s/text_%zu.txt", data_dir, size);
+            break;
+        case NUMBERS:
+            snprintf(numbers_dir, PATH_MAX, "%s/numbers_%zu", data_dir, size);
+            *cwd = numbers_dir;
+            break;
+        case REPLACE_EQ:
+        case REPLACE_NE:
+            snprintf(args[n++], PATH_MAX, "%s/text_%zu.txt", data_dir, size);
+            snprintf(args[n++], PATH_MAX, "%s/replaced.txt", data_dir);
+            snprintf(args[n++], PATH_MAX, "ABC");
+            snprintf(args[n++], PATH_MAX, bench->kind == REPLACE_EQ ? "xyz" : "xyzxyz");
+            break;
+        case WRAP:
+        case WRAP_UTF8:
+            if (bench->kind == WRAP_UTF8) {
+                snprintf(args[n++], PATH_MAX, "-u");
+            }
+            snprintf(args[n++], PATH_MAX, "%s/long_%zu.txt", data_dir, size);
+            snprintf(args[n++], PATH_MAX, "%s/split.txt", data_dir);
+            break;
+    }
+
+    return n;
+}
+
+//wall time of a single run in seconds, negative if it did not exit cleanly
+double run_once(const char *binary, char **argv, const char *cwd) {
+    struct timespec start;
+    struct timespec end;
+
+    fflush(stdout);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return -1;
+    }
+
+    if (pid == 0) {
+        int dev_null = open("/dev/null", O_WRONLY);
+        dup2(dev_null, STDOUT_FILENO);
+        close(dev_null);
+
+        if (cwd && chdir(cwd) == -1) {
+            _exit(EXIT_FAILURE);
+        }
+
+        execv(binary, argv);
+        _exit(EXIT_FAILURE);
+    }
+
+    int wstatus;
+    waitpid(pid, &wstatus, 0);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) {
+        return -1;
+    }
+
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+//mean throughput with half-width of its 95% confidence interval
+bench_stats compute_stats(const double *samples, size_t n) {
+    bench_stats stats = { .runs = n };
+    if (n == 0) {
+        return stats;
+    }
+
+    double sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += samples[i];
+        if (samples[i] > stats.best) {
+            stats.best = samples[i];
+        }
+    }
+    stats.mean = sum / n;
+
+    if (n > 1) {
+        double sq_sum = 0;
+        for (size_t i = 0; i < n; i++) {
+            sq_sum += (samples[i] - stats.mean) * (samples[i] - stats.mean);
+        }
+
+        double stddev = sqrt(sq_sum / (n - 1));
+        stats.ci95 = student_t95(n - 1) * stddev / sqrt(n);
+    }
+
+    return stats;
+}
+
+//two-sided 95% quantiles of student's t distribution
+double student_t95(size_t df) {
+    static const double table[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+
+    if (df <= sizeof(table) / sizeof(*table)) {
+        return table[df - 1];
+    }
+
+    return 1.960;
+}
+
+uint64_t xorshift64(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
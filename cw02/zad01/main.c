@@ -7,6 +7,11 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#ifdef THREADS
+    #include <pthread.h>
+    #include <stdbool.h>
+#endif
+
 #ifdef LIB
     #define FILE_TYPE FILE*
     #define FILE_NONE NULL
@@ -28,6 +33,43 @@
 FILE_TYPE open_from_stdin(const char *message);
 size_t rewrite_line(FILE_TYPE from, FILE_TYPE to);
 
+#ifdef THREADS
+#define RING_SLOTS 4
+#define SLOT_SIZE (1 << 20)
+#define OUT_SIZE (1 << 20)
+
+/**
+ * bounded ring of large buffers filled by a dedicated reader thread,
+ * an empty slot marks the end of input
+ */
+typedef struct {
+    int fd;
+    char *slots[RING_SLOTS];
+    size_t lens[RING_SLOTS];
+    size_t head;
+    size_t tail;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    pthread_t reader;
+    //consumer position inside slot tail
+    size_t pos;
+} line_ring;
+
+typedef struct {
+    int fd;
+    char *buf;
+    size_t len;
+} out_buffer;
+
+void ring_init(line_ring *ring, int fd);
+void ring_destroy(line_ring *ring);
+void *ring_reader(void *arg);
+size_t ring_rewrite_line(line_ring *ring, out_buffer *out);
+void out_append(out_buffer *out, const char *data, size_t len);
+void out_flush(out_buffer *out);
+#endif
+
 int main(int argc, char **argv) {
     if (argc > 3) {
         printf("invalid argument count\n");
@@ -49,11 +91,32 @@ int main(int argc, char **argv) {
     size_t rewritten_a;
     size_t rewritten_b;
 
+#ifdef THREADS
+    line_ring ring_a;
+    line_ring ring_b;
+    out_buffer out = { .fd = FILE_STDOUT, .buf = malloc(OUT_SIZE) };
+
+    ring_init(&ring_a, file_a);
+    ring_init(&ring_b, file_b);
+
+    do {
+        rewritten_a = ring_rewrite_line(&ring_a, &out);
+        rewritten_b = ring_rewrite_line(&ring_b, &out);
+    }
+    while (rewritten_a != 0 || rewritten_b != 0);
+
+    out_flush(&out);
+    free(out.buf);
+
+    ring_destroy(&ring_a);
+    ring_destroy(&ring_b);
+#else
     do {
         rewritten_a = rewrite_line(file_a, FILE_STDOUT);
         rewritten_b = rewrite_line(file_b, FILE_STDOUT);
     }
     while (rewritten_a != 0 || rewritten_b != 0);
+#endif
 
     FILE_CLOSE(file_a);
     FILE_CLOSE(file_b);
@@ -88,3 +151,163 @@ size_t rewrite_line(FILE_TYPE from, FILE_TYPE to) {
 
     return rewritten;
 }
+
+#ifdef THREADS
+void ring_init(line_ring *ring, int fd) {
+    ring->fd = fd;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->pos = 0;
+
+    for (size_t i = 0; i < RING_SLOTS; i++) {
+        ring->slots[i] = malloc(SLOT_SIZE);
+    }
+
+    pthread_mutex_init(&ring->mutex, NULL);
+    pthread_cond_init(&ring->not_empty, NULL);
+    pthread_cond_init(&ring->not_full, NULL);
+
+    pthread_create(&ring->reader, NULL, ring_reader, ring);
+}
+
+//only valid once the consumer has seen the end of input, so the reader is done
+void ring_destroy(line_ring *ring) {
+    pthread_join(ring->reader, NULL);
+
+    for (size_t i = 0; i < RING_SLOTS; i++) {
+        free(ring->slots[i]);
+    }
+
+    pthread_mutex_destroy(&ring->mutex);
+    pthread_cond_destroy(&ring->not_empty);
+    pthread_cond_destroy(&ring->not_full);
+}
+
+void *ring_reader(void *arg) {
+    line_ring *ring = arg;
+    size_t len;
+
+    do {
+        pthread_mutex_lock(&ring->mutex);
+        while (ring->head - ring->tail == RING_SLOTS) {
+            pthread_cond_wait(&ring->not_full, &ring->mutex);
+        }
+        pthread_mutex_unlock(&ring->mutex);
+
+        //slot head is not visible to the consumer until head gets bumped, fill it unlocked
+        char *slot = ring->slots[ring->head % RING_SLOTS];
+        len = 0;
+
+        while (len < SLOT_SIZE) {
+            ssize_t n = read(ring->fd, &slot[len], SLOT_SIZE - len);
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+
+            if (n <= 0) {
+                if (n == -1) {
+                    perror("read");
+                }
+                break;
+            }
+
+            len += n;
+        }
+
+        pthread_mutex_lock(&ring->mutex);
+        ring->lens[ring->head % RING_SLOTS] = len;
+        ring->head++;
+        pthread_cond_signal(&ring->not_empty);
+        pthread_mutex_unlock(&ring->mutex);
+    }
+    while (len == SLOT_SIZE);
+
+    //a short slot means end of input, push the empty terminator unless that one was it
+    if (len > 0) {
+        pthread_mutex_lock(&ring->mutex);
+        while (ring->head - ring->tail == RING_SLOTS) {
+            pthread_cond_wait(&ring->not_full, &ring->mutex);
+        }
+        ring->lens[ring->head % RING_SLOTS] = 0;
+        ring->head++;
+        pthread_cond_signal(&ring->not_empty);
+        pthread_mutex_unlock(&ring->mutex);
+    }
+
+    return NULL;
+}
+
+size_t ring_rewrite_line(line_ring *ring, out_buffer *out) {
+    size_t rewritten = 0;
+
+    while (true) {
+        pthread_mutex_lock(&ring->mutex);
+        while (ring->head == ring->tail) {
+            pthread_cond_wait(&ring->not_empty, &ring->mutex);
+        }
+        size_t slot_len = ring->lens[ring->tail % RING_SLOTS];
+        pthread_mutex_unlock(&ring->mutex);
+
+        //the terminator stays in place, so further calls keep returning 0
+        if (slot_len == 0) {
+            return rewritten;
+        }
+
+        char *slot = ring->slots[ring->tail % RING_SLOTS];
+        char *line_end = memchr(&slot[ring->pos], '\n', slot_len - ring->pos);
+        size_t len = line_end ? (size_t)(line_end - &slot[ring->pos]) + 1 : slot_len - ring->pos;
+
+        out_append(out, &slot[ring->pos], len);
+        rewritten += len;
+        ring->pos += len;
+
+        if (ring->pos == slot_len) {
+            pthread_mutex_lock(&ring->mutex);
+            ring->tail++;
+            pthread_cond_signal(&ring->not_full);
+            pthread_mutex_unlock(&ring->mutex);
+
+            ring->pos = 0;
+        }
+
+        if (line_end) {
+            return rewritten;
+        }
+    }
+}
+
+void out_append(out_buffer *out, const char *data, size_t len) {
+    if (out->len + len > OUT_SIZE) {
+        out_flush(out);
+    }
+
+    //lines longer than the whole buffer go straight through
+    if (len >= OUT_SIZE) {
+        out_buffer direct = { .fd = out->fd, .buf = (char *)data, .len = len };
+        out_flush(&direct);
+        return;
+    }
+
+    memcpy(&out->buf[out->len], data, len);
+    out->len += len;
+}
+
+void out_flush(out_buffer *out) {
+    size_t written = 0;
+
+    while (written < out->len) {
+        ssize_t n = write(out->fd, &out->buf[written], out->len - written);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("write");
+            break;
+        }
+
+        written += n;
+    }
+
+    out->len = 0;
+}
+#endif
@@ -1,3 +1,5 @@
+#define _GNU_SOURCE //enable fallocate, copy_file_range
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
@@ -8,6 +10,10 @@
 #include <unistd.h>
 #include <stdbool.h>
 
+#ifdef MMAP
+    #include <sys/mman.h>
+#endif
+
 #ifdef LIB
     #define FILE_TYPE FILE*
     #define FILE_NONE NULL
@@ -27,6 +33,7 @@
 #endif
 
 bool kmp_file_replace(char *from_path, char *to_path, char *needle, char *replacement);
+size_t *kmp_prefix_fun(const char *needle, size_t needle_len);
 
 int main(int argc, char **argv) {
     if (argc != 5) {
@@ -39,6 +46,7 @@ int main(int argc, char **argv) {
     }
 }
 
+#ifndef MMAP
 bool kmp_file_replace(char *from_path, char *to_path, char *needle, char *replacement) {
     FILE_TYPE from = FILE_OPEN_READ(from_path);
     if (from == FILE_NONE) {
@@ -65,21 +73,7 @@ bool kmp_file_replace(char *from_path, char *to_path, char *needle, char *replac
     size_t head_idx = 0;
     size_t tail_idx = 0;
 
-    size_t *prefix_fun = malloc(needle_len * sizeof(*prefix_fun));
-    size_t k = 0;
-
-    prefix_fun[0] = 0;
-    for (size_t q = 1; q < needle_len; q++) {
-        while (k > 0 && needle[k] != needle[q]) {
-            k = prefix_fun[k - 1];
-        }
-
-        if (needle[k] == needle[q]) {
-            k++;
-        }
-
-        prefix_fun[q] = k;
-    }
+    size_t *prefix_fun = kmp_prefix_fun(needle, needle_len);
 
     size_t matches = 0;
 
@@ -126,3 +120,225 @@ bool kmp_file_replace(char *from_path, char *to_path, char *needle, char *replac
 
     return true;
 }
+#endif
+
+size_t *kmp_prefix_fun(const char *needle, size_t needle_len) {
+    size_t *prefix_fun = malloc(needle_len * sizeof(*prefix_fun));
+    size_t k = 0;
+
+    prefix_fun[0] = 0;
+    for (size_t q = 1; q < needle_len; q++) {
+        while (k > 0 && needle[k] != needle[q]) {
+            k = prefix_fun[k - 1];
+        }
+
+        if (needle[k] == needle[q]) {
+            k++;
+        }
+
+        prefix_fun[q] = k;
+    }
+
+    return prefix_fun;
+}
+
+#ifdef MMAP
+/**
+ * returns offset of the first match starting at or after from, or len if there is none
+ * 
+ * matches never overlap (the automaton is reset after each one, like in the streaming version),
+ * so bytes behind a returned match can be safely overwritten before searching further
+ */
+size_t kmp_next_match(const char *data, size_t len, size_t from, const char *needle, size_t needle_len, const size_t *prefix_fun) {
+    size_t matches = 0;
+
+    for (size_t i = from; i < len; i++) {
+        while (matches > 0 && needle[matches] != data[i]) {
+            matches = prefix_fun[matches - 1];
+        }
+
+        if (needle[matches] == data[i]) {
+            matches++;
+        }
+
+        if (matches == needle_len) {
+            return i + 1 - needle_len;
+        }
+    }
+
+    return len;
+}
+
+char *map_file(int fd, size_t size, int prot) {
+    //mmap refuses empty mappings, hand out something harmless instead
+    if (size == 0) {
+        return (char *)"";
+    }
+
+    char *map = mmap(NULL, size, prot, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        printf("%s\n", strerror(errno));
+        return NULL;
+    }
+
+    madvise(map, size, MADV_SEQUENTIAL);
+    return map;
+}
+
+void unmap_file(char *map, size_t size) {
+    if (size > 0) {
+        munmap(map, size);
+    }
+}
+
+/**
+ * copies the whole file inside the kernel (which may even share extents on cow filesystems),
+ * so the equal-length case can be finished by patching the copy in place
+ */
+bool copy_file(int from, int to, size_t size) {
+    loff_t from_off = 0;
+    loff_t to_off = 0;
+
+    while (size > 0) {
+        ssize_t copied = copy_file_range(from, &from_off, to, &to_off, size, 0);
+        if (copied <= 0) {
+            return false;
+        }
+
+        size -= copied;
+    }
+
+    return true;
+}
+
+bool kmp_map_patch(int fd, size_t size, char *needle, char *replacement, size_t needle_len, size_t *prefix_fun) {
+    char *map = map_file(fd, size, PROT_READ | PROT_WRITE);
+    if (!map) {
+        return false;
+    }
+
+    size_t match = 0;
+    while ((match = kmp_next_match(map, size, match, needle, needle_len, prefix_fun)) < size) {
+        memcpy(&map[match], replacement, needle_len);
+        match += needle_len;
+    }
+
+    unmap_file(map, size);
+    return true;
+}
+
+bool kmp_map_fill(int from, size_t from_size, int to, char *needle, char *replacement, size_t needle_len, size_t replacement_len, size_t *prefix_fun) {
+    char *src = map_file(from, from_size, PROT_READ);
+    if (!src) {
+        return false;
+    }
+
+    //first pass: count matches to know the exact output size up front
+    size_t match_count = 0;
+    size_t match = 0;
+    while ((match = kmp_next_match(src, from_size, match, needle, needle_len, prefix_fun)) < from_size) {
+        match_count++;
+        match += needle_len;
+    }
+
+    size_t to_size = from_size - match_count * needle_len + match_count * replacement_len;
+
+    //reserve all blocks at once, fall back to a sparse file where fallocate is not supported
+    if (to_size > 0 && fallocate(to, 0, 0, to_size) == -1 && ftruncate(to, to_size) == -1) {
+        printf("%s\n", strerror(errno));
+        unmap_file(src, from_size);
+        return false;
+    }
+
+    char *dst = map_file(to, to_size, PROT_READ | PROT_WRITE);
+    if (!dst) {
+        unmap_file(src, from_size);
+        return false;
+    }
+
+    //second pass: copy runs between matches and fill in replacements
+    size_t copied = 0;
+    size_t written = 0;
+    match = 0;
+    while ((match = kmp_next_match(src, from_size, match, needle, needle_len, prefix_fun)) < from_size) {
+        memcpy(&dst[written], &src[copied], match - copied);
+        written += match - copied;
+
+        memcpy(&dst[written], replacement, replacement_len);
+        written += replacement_len;
+
+        match += needle_len;
+        copied = match;
+    }
+
+    memcpy(&dst[written], &src[copied], from_size - copied);
+
+    unmap_file(dst, to_size);
+    unmap_file(src, from_size);
+    return true;
+}
+
+bool kmp_file_replace(char *from_path, char *to_path, char *needle, char *replacement) {
+    size_t needle_len = strlen(needle);
+    size_t replacement_len = strlen(replacement);
+    if (needle_len == 0) {
+        return false;
+    }
+
+    int from = open(from_path, O_RDONLY);
+    if (from == -1) {
+        printf("%s\n", strerror(errno));
+        return false;
+    }
+
+    struct stat from_stat;
+    if (fstat(from, &from_stat) == -1) {
+        printf("%s\n", strerror(errno));
+        close(from);
+        return false;
+    }
+
+    size_t from_size = from_stat.st_size;
+
+    //must be detected before to_path gets truncated
+    struct stat to_stat;
+    bool in_place = stat(to_path, &to_stat) == 0
+                 && to_stat.st_dev == from_stat.st_dev
+                 && to_stat.st_ino == from_stat.st_ino;
+
+    if (in_place && needle_len != replacement_len) {
+        printf("in-place replacement requires needle and replacement of equal length\n");
+        close(from);
+        return false;
+    }
+
+    int to = in_place
+           ? open(to_path, O_RDWR)
+           : open(to_path, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
+    if (to == -1) {
+        printf("%s\n", strerror(errno));
+        close(from);
+        return false;
+    }
+
+    size_t *prefix_fun = kmp_prefix_fun(needle, needle_len);
+    bool result;
+
+    if (in_place) {
+        result = kmp_map_patch(to, from_size, needle, replacement, needle_len, prefix_fun);
+    }
+    else if (needle_len == replacement_len && copy_file(from, to, from_size)) {
+        result = kmp_map_patch(to, from_size, needle, replacement, needle_len, prefix_fun);
+    }
+    else {
+        result = kmp_map_fill(from, from_size, to, needle, replacement, needle_len, replacement_len, prefix_fun);
+    }
+
+    free(prefix_fun);
+
+    close(from);
+    close(to);
+
+    return result;
+}
+#endif
@@ -1,3 +1,5 @@
+#define _GNU_SOURCE //enable IOV_MAX
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
@@ -6,6 +8,14 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
 
 #ifdef LIB
     #define FILE_TYPE FILE*
@@ -25,12 +35,63 @@
     #define FILE_CLOSE(file) close(file)
 #endif
 
+#ifndef BLOCK_SIZE
+    #define BLOCK_SIZE (1 << 16)
+#endif
+#define DEFAULT_WIDTH 50
+#define UTF8_INVALID UINT32_MAX
+#define ZERO_WIDTH_JOINER 0x200D
+
+typedef struct {
+    struct iovec iov[IOV_MAX];
+    int count;
+} iov_queue;
+
+typedef struct {
+    size_t width;
+    size_t line_length;
+    //utf8 mode only: line is full, but the break waits for trailing combining marks
+    bool break_pending;
+    bool after_joiner;
+    size_t malformed;
+} wrap_state;
+
+bool wrap_bytes(iov_queue *queue, FILE_TYPE to, const char *buf, size_t len, wrap_state *state);
+bool wrap_utf8(iov_queue *queue, FILE_TYPE to, const char *buf, size_t len, bool eof, wrap_state *state, size_t *consumed);
+size_t utf8_decode(const unsigned char *s, size_t len, uint32_t *code_point);
+bool utf8_zero_width(uint32_t code_point);
+bool queue_push(iov_queue *queue, FILE_TYPE to, const char *data, size_t len);
+bool queue_flush(iov_queue *queue, FILE_TYPE to);
+
+static const char newline = '\n';
+
 int main(int argc, char **argv) {
-    if (argc != 3) {
+    bool utf8 = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "u")) != -1) {
+        if (opt == 'u') {
+            utf8 = true;
+        }
+        else {
+            return EXIT_FAILURE;
+        }
+    }
+
+    argc -= optind - 1;
+    argv += optind - 1;
+
+    if (argc != 3 && argc != 4) {
         printf("invalid argument count\n");
         return EXIT_FAILURE;
     }
 
+    wrap_state state = { .width = DEFAULT_WIDTH };
+    if (argc == 4 && (sscanf(argv[3], "%zu", &state.width) != 1 || state.width == 0)) {
+        printf("malformed width argument\n");
+        return EXIT_FAILURE;
+    }
+
     FILE_TYPE from = FILE_OPEN_READ(argv[1]);
     if (from == FILE_NONE) {
         printf("%s\n", strerror(errno));
@@ -44,24 +105,294 @@ int main(int argc, char **argv) {
         return EXIT_FAILURE;
     }
 
-    size_t line_length = 0;
-    char newline = '\n';
-    char buf;
-    while (FILE_READ_CHARS(from, &buf, 1) == 1) {
-        FILE_WRITE_CHARS(to, &buf, 1);
-        line_length++;
+    static char buf[BLOCK_SIZE];
+    static iov_queue queue;
+
+    //bytes of an incomplete utf8 sequence left over from the previous block
+    size_t carried = 0;
+    bool ok = true;
+
+    while (ok) {
+        ssize_t n = FILE_READ_CHARS(from, &buf[carried], BLOCK_SIZE - carried);
+        if (n < 0) {
+            ok = false;
+            break;
+        }
+
+        bool eof = n == 0;
+        size_t len = carried + n;
+        size_t consumed = len;
 
-        if (buf == '\n') {
-            line_length = 0;
+        if (utf8) {
+            ok = wrap_utf8(&queue, to, buf, len, eof, &state, &consumed);
         }
         else {
-            if (line_length == 50) {
-                FILE_WRITE_CHARS(to, &newline, 1);
-                line_length = 0;
-            }
+            ok = wrap_bytes(&queue, to, buf, len, &state);
         }
+
+        //iovecs point into buf, they must be written out before it gets overwritten
+        ok = ok && queue_flush(&queue, to);
+
+        carried = len - consumed;
+        memmove(buf, &buf[consumed], carried);
+
+        if (eof) {
+            break;
+        }
+    }
+
+    if (ok && state.break_pending) {
+        ok = FILE_WRITE_CHARS(to, &newline, 1) == 1;
+    }
+
+    if (!ok) {
+        printf("%s\n", strerror(errno));
+    }
+
+    if (state.malformed > 0) {
+        fprintf(stderr, "%zu malformed utf8 bytes, wrapped as single characters\n", state.malformed);
     }
 
     FILE_CLOSE(from);
     FILE_CLOSE(to);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+bool wrap_bytes(iov_queue *queue, FILE_TYPE to, const char *buf, size_t len, wrap_state *state) {
+    size_t pos = 0;
+    bool ok = true;
+
+    while (ok && pos < len) {
+        size_t room = state->width - state->line_length;
+        size_t span = len - pos < room ? len - pos : room;
+
+        const char *line_end = memchr(&buf[pos], '\n', span);
+        if (line_end) {
+            size_t line_len = line_end - &buf[pos] + 1;
+            ok = queue_push(queue, to, &buf[pos], line_len);
+            pos += line_len;
+            state->line_length = 0;
+        }
+        else {
+            ok = queue_push(queue, to, &buf[pos], span);
+            pos += span;
+            state->line_length += span;
+
+            if (state->line_length == state->width) {
+                ok = ok && queue_push(queue, to, &newline, 1);
+                state->line_length = 0;
+            }
+        }
+    }
+
+    return ok;
+}
+
+/**
+ * same as wrap_bytes, but the width is counted in code points and a line is never broken
+ * before a combining mark or after a zero width joiner, so neither multibyte sequences
+ * nor the common grapheme clusters get split
+ * 
+ * an incomplete sequence at the end of buf is left unconsumed unless eof is set,
+ * malformed bytes count as one column each
+ */
+bool wrap_utf8(iov_queue *queue, FILE_TYPE to, const char *buf, size_t len, bool eof, wrap_state *state, size_t *consumed) {
+    size_t start = 0;
+    size_t pos = 0;
+    bool ok = true;
+
+    while (ok && pos < len) {
+#ifdef __SSE2__
+        //ascii fast path: 16 bytes with no high bits and no newline are exactly 16 columns
+        while (!state->break_pending && !state->after_joiner
+                && len - pos >= 16 && state->width - state->line_length >= 16) {
+            __m128i chunk = _mm_loadu_si128((const __m128i *)&buf[pos]);
+            int non_ascii = _mm_movemask_epi8(chunk);
+            int newlines = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n')));
+
+            if (non_ascii | newlines) {
+                break;
+            }
+
+            pos += 16;
+            state->line_length += 16;
+            state->break_pending = state->line_length == state->width;
+        }
+
+        if (pos == len) {
+            break;
+        }
+#endif
+
+        uint32_t code_point;
+        size_t seq_len = utf8_decode((const unsigned char *)&buf[pos], len - pos, &code_point);
+        if (seq_len == 0) {
+            if (!eof) {
+                break;
+            }
+
+            code_point = UTF8_INVALID;
+            seq_len = 1;
+        }
+
+        if (code_point == UTF8_INVALID) {
+            state->malformed++;
+        }
+
+        bool zero_width = code_point != UTF8_INVALID
+                       && (state->after_joiner || utf8_zero_width(code_point));
+        state->after_joiner = code_point == ZERO_WIDTH_JOINER;
+
+        if (state->break_pending && !zero_width) {
+            ok = queue_push(queue, to, &buf[start], pos - start)
+              && queue_push(queue, to, &newline, 1);
+            start = pos;
+            state->break_pending = false;
+            state->line_length = 0;
+        }
+
+        pos += seq_len;
+
+        if (code_point == '\n') {
+            state->line_length = 0;
+        }
+        else if (!zero_width && ++state->line_length == state->width) {
+            state->break_pending = true;
+        }
+    }
+
+    *consumed = pos;
+    return ok && queue_push(queue, to, &buf[start], pos - start);
+}
+
+/**
+ * returns length of the sequence at s, or 0 if it is a valid but truncated prefix
+ * 
+ * malformed input (stray continuations, overlongs, surrogates, > U+10FFFF)
+ * yields UTF8_INVALID with length 1, so decoding resynchronizes on the next byte
+ */
+size_t utf8_decode(const unsigned char *s, size_t len, uint32_t *code_point) {
+    if (s[0] < 0x80) {
+        *code_point = s[0];
+        return 1;
+    }
+
+    size_t seq_len;
+    unsigned char min = 0x80;
+    unsigned char max = 0xBF;
+
+    if (s[0] >= 0xC2 && s[0] <= 0xDF) {
+        seq_len = 2;
+        *code_point = s[0] & 0x1F;
+    }
+    else if (s[0] >= 0xE0 && s[0] <= 0xEF) {
+        seq_len = 3;
+        *code_point = s[0] & 0x0F;
+        if (s[0] == 0xE0) min = 0xA0;
+        if (s[0] == 0xED) max = 0x9F;
+    }
+    else if (s[0] >= 0xF0 && s[0] <= 0xF4) {
+        seq_len = 4;
+        *code_point = s[0] & 0x07;
+        if (s[0] == 0xF0) min = 0x90;
+        if (s[0] == 0xF4) max = 0x8F;
+    }
+    else {
+        *code_point = UTF8_INVALID;
+        return 1;
+    }
+
+    for (size_t i = 1; i < seq_len; i++) {
+        if (i == len) {
+            return 0;
+        }
+
+        if (s[i] < min || s[i] > max) {
+            *code_point = UTF8_INVALID;
+            return 1;
+        }
+
+        *code_point = (*code_point << 6) | (s[i] & 0x3F);
+        min = 0x80;
+        max = 0xBF;
+    }
+
+    return seq_len;
+}
+
+//combining marks, variation selectors, joiner and emoji modifiers
+bool utf8_zero_width(uint32_t code_point) {
+    return (code_point >= 0x0300 && code_point <= 0x036F)
+        || (code_point >= 0x1AB0 && code_point <= 0x1AFF)
+        || (code_point >= 0x1DC0 && code_point <= 0x1DFF)
+        || (code_point >= 0x20D0 && code_point <= 0x20FF)
+        || (code_point >= 0xFE00 && code_point <= 0xFE0F)
+        || (code_point >= 0xFE20 && code_point <= 0xFE2F)
+        || (code_point >= 0x1F3FB && code_point <= 0x1F3FF)
+        || (code_point >= 0xE0100 && code_point <= 0xE01EF)
+        || code_point == ZERO_WIDTH_JOINER;
+}
+
+bool queue_push(iov_queue *queue, FILE_TYPE to, const char *data, size_t len) {
+    if (len == 0) {
+        return true;
+    }
+
+    //runs split only by a line limit are contiguous in the buffer, glue them back together
+    if (queue->count > 0) {
+        struct iovec *last = &queue->iov[queue->count - 1];
+        if ((char *)last->iov_base + last->iov_len == data) {
+            last->iov_len += len;
+            return true;
+        }
+    }
+
+    if (queue->count == IOV_MAX && !queue_flush(queue, to)) {
+        return false;
+    }
+
+    queue->iov[queue->count].iov_base = (void *)data;
+    queue->iov[queue->count].iov_len = len;
+    queue->count++;
+
+    return true;
+}
+
+bool queue_flush(iov_queue *queue, FILE_TYPE to) {
+    struct iovec *iov = queue->iov;
+    int count = queue->count;
+    queue->count = 0;
+
+#ifdef LIB
+    for (int i = 0; i < count; i++) {
+        if (FILE_WRITE_CHARS(to, iov[i].iov_base, iov[i].iov_len) != iov[i].iov_len) {
+            return false;
+        }
+    }
+#else
+    while (count > 0) {
+        ssize_t written = writev(to, iov, count);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+
+        //skip fully written iovecs, trim the partially written one
+        while (count > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+#endif
+
+    return true;
 }
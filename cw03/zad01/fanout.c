@@ -0,0 +1,362 @@
+#define _GNU_SOURCE //enable clone
+
+#include "fanout.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+
+#define CLONE_STACK_SIZE (256 * 1024)
+#define REAP_BATCH 64
+//how often children without a pidfd get checked on while waiting for the rest
+#define UNWATCHED_POLL_MS 10
+
+typedef struct {
+    fanout_fn fn;
+    void *arg;
+    sigset_t *mask;
+} clone_args;
+
+static const char *method_names[] = { "fork", "clone", "posix_spawn" };
+
+static int pidfd_open(pid_t pid) {
+    return syscall(SYS_pidfd_open, pid, 0);
+}
+
+static double elapsed_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int clone_trampoline(void *arg) {
+    clone_args *args = arg;
+    sigprocmask(SIG_SETMASK, args->mask, NULL);
+
+    return args->fn(args->arg);
+}
+
+static void child_exited(fanout *f, size_t idx, int wstatus) {
+    fanout_child *child = &f->children[idx];
+
+    child->wstatus = wstatus;
+    child->lifetime = elapsed_since(&child->started);
+
+    if (child->pidfd != -1) {
+        close(child->pidfd);
+        child->pidfd = -1;
+    }
+
+    f->running--;
+}
+
+bool fanout_init(fanout *f, fanout_method method) {
+    f->method = method;
+    f->children = NULL;
+    f->count = 0;
+    f->capacity = 0;
+    f->running = 0;
+    f->epoll_fd = -1;
+    f->unwatched = NULL;
+    f->unwatched_count = 0;
+    f->unwatched_capacity = 0;
+    f->signal_fd = -1;
+    f->clone_stack = NULL;
+
+    sigprocmask(SIG_SETMASK, NULL, &f->child_mask);
+
+    //probe for pidfd support on ourselves, fall back to signalfd on older kernels
+    int self_pidfd = pidfd_open(getpid());
+    if (self_pidfd != -1) {
+        close(self_pidfd);
+
+        f->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (f->epoll_fd == -1) {
+            perror("epoll_create1");
+            return false;
+        }
+    }
+    else {
+        //SIGCHLD has to be blocked for signalfd to see it, children get the old mask back
+        sigset_t chld;
+        sigemptyset(&chld);
+        sigaddset(&chld, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &chld, &f->child_mask);
+
+        f->signal_fd = signalfd(-1, &chld, SFD_CLOEXEC | SFD_NONBLOCK);
+        if (f->signal_fd == -1) {
+            perror("signalfd");
+            return false;
+        }
+    }
+
+    if (method == FANOUT_CLONE) {
+        //CLONE_VFORK suspends us until the child is gone, so one stack serves them all
+        f->clone_stack = malloc(CLONE_STACK_SIZE);
+    }
+
+    return true;
+}
+
+pid_t fanout_start(fanout *f, fanout_fn fn, void *arg, char *const spawn_argv[], char *const spawn_envp[]) {
+    if (f->count == f->capacity) {
+        f->capacity = f->capacity == 0 ? 64 : 2 * f->capacity;
+        f->children = reallocarray(f->children, f->capacity, sizeof(*f->children));
+    }
+
+    fanout_child *child = &f->children[f->count];
+    child->pidfd = -1;
+    child->lifetime = 0;
+
+    fflush(stdout);
+    fflush(stderr);
+
+    clock_gettime(CLOCK_MONOTONIC, &child->started);
+
+    pid_t pid;
+    switch (f->method) {
+        case FANOUT_FORK:
+            pid = fork();
+            if (pid == 0) {
+                sigprocmask(SIG_SETMASK, &f->child_mask, NULL);
+                _exit(fn(arg));
+            }
+            break;
+
+        case FANOUT_CLONE: {
+            clone_args args = { .fn = fn, .arg = arg, .mask = &f->child_mask };
+            pid = clone(clone_trampoline, f->clone_stack + CLONE_STACK_SIZE, CLONE_VM | CLONE_VFORK | SIGCHLD, &args);
+            break;
+        }
+
+        case FANOUT_SPAWN: {
+            posix_spawnattr_t attr;
+            posix_spawnattr_init(&attr);
+            posix_spawnattr_setsigmask(&attr, &f->child_mask);
+            posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+            int err = posix_spawn(&pid, spawn_argv[0], NULL, &attr, spawn_argv, spawn_envp);
+            posix_spawnattr_destroy(&attr);
+
+            if (err != 0) {
+                errno = err;
+                pid = -1;
+            }
+            break;
+        }
+
+        default:
+            pid = -1;
+    }
+
+    if (pid == -1) {
+        perror(method_names[f->method]);
+        return -1;
+    }
+
+    child->spawn_latency = elapsed_since(&child->started);
+    child->pid = pid;
+
+    if (f->epoll_fd != -1) {
+        child->pidfd = pidfd_open(pid);
+
+        struct epoll_event event = { .events = EPOLLIN, .data.u64 = f->count };
+        if (child->pidfd == -1 || epoll_ctl(f->epoll_fd, EPOLL_CTL_ADD, child->pidfd, &event) == -1) {
+            //out of fds most likely, the child still gets reaped, just by polling
+            if (child->pidfd != -1) {
+                close(child->pidfd);
+                child->pidfd = -1;
+            }
+
+            if (f->unwatched_count == f->unwatched_capacity) {
+                f->unwatched_capacity = f->unwatched_capacity == 0 ? 64 : 2 * f->unwatched_capacity;
+                f->unwatched = reallocarray(f->unwatched, f->unwatched_capacity, sizeof(*f->unwatched));
+            }
+            f->unwatched[f->unwatched_count++] = f->count;
+        }
+    }
+
+    f->count++;
+    f->running++;
+
+    return pid;
+}
+
+static size_t reap_unwatched(fanout *f) {
+    size_t reaped = 0;
+
+    for (size_t i = 0; i < f->unwatched_count;) {
+        size_t idx = f->unwatched[i];
+        int wstatus;
+
+        if (waitpid(f->children[idx].pid, &wstatus, WNOHANG) > 0) {
+            child_exited(f, idx, wstatus);
+            f->unwatched[i] = f->unwatched[--f->unwatched_count];
+            reaped++;
+        }
+        else {
+            i++;
+        }
+    }
+
+    return reaped;
+}
+
+/**
+ * reaps whatever has exited within timeout_ms (-1 blocks until at least one child does),
+ * returns the number of children reaped
+ */
+size_t fanout_reap(fanout *f, int timeout_ms) {
+    size_t reaped = 0;
+
+    if (f->running == 0) {
+        return 0;
+    }
+
+    if (f->epoll_fd != -1) {
+        struct epoll_event events[REAP_BATCH];
+
+        reaped = reap_unwatched(f);
+        if (reaped > 0 || f->running == 0) {
+            return reaped;
+        }
+
+        //nothing tells us when an unwatched child exits, so don't sleep for long
+        int wait_ms = timeout_ms;
+        if (f->unwatched_count > 0 && (timeout_ms == -1 || timeout_ms > UNWATCHED_POLL_MS)) {
+            wait_ms = UNWATCHED_POLL_MS;
+        }
+
+        int ready = epoll_wait(f->epoll_fd, events, REAP_BATCH, wait_ms);
+        for (int i = 0; i < ready; i++) {
+            size_t idx = events[i].data.u64;
+            int wstatus;
+
+            if (waitpid(f->children[idx].pid, &wstatus, 0) > 0) {
+                child_exited(f, idx, wstatus);
+                reaped++;
+            }
+        }
+
+        reaped += reap_unwatched(f);
+        if (reaped == 0 && timeout_ms == -1) {
+            return fanout_reap(f, -1);
+        }
+
+        return reaped;
+    }
+
+    //signalfd fallback: SIGCHLDs coalesce, so just drain them and reap everything available
+    struct signalfd_siginfo info;
+    while (read(f->signal_fd, &info, sizeof(info)) == sizeof(info))
+        ;
+
+    pid_t pid;
+    int wstatus;
+    while ((pid = waitpid(-1, &wstatus, WNOHANG)) > 0) {
+        for (size_t idx = f->count; idx-- > 0;) {
+            if (f->children[idx].pid == pid) {
+                child_exited(f, idx, wstatus);
+                reaped++;
+                break;
+            }
+        }
+    }
+
+    if (reaped == 0 && timeout_ms != 0) {
+        struct pollfd pfd = { .fd = f->signal_fd, .events = POLLIN };
+        if (poll(&pfd, 1, timeout_ms) > 0) {
+            return fanout_reap(f, 0);
+        }
+    }
+
+    return reaped;
+}
+
+void fanout_wait_all(fanout *f) {
+    while (f->running > 0) {
+        fanout_reap(f, -1);
+    }
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double lhs = *(const double *)a;
+    double rhs = *(const double *)b;
+
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+static double percentile(const double *sorted, size_t n, double p) {
+    //nearest rank
+    size_t rank = (size_t)(p * n);
+    if (rank < p * n) {
+        rank++;
+    }
+
+    return sorted[rank == 0 ? 0 : rank - 1];
+}
+
+void fanout_report(fanout *f, FILE *out) {
+    if (f->count == 0) {
+        return;
+    }
+
+    double *spawn = malloc(f->count * sizeof(*spawn));
+    double *lifetime = malloc(f->count * sizeof(*lifetime));
+
+    for (size_t i = 0; i < f->count; i++) {
+        spawn[i] = f->children[i].spawn_latency * 1e6;
+        lifetime[i] = f->children[i].lifetime * 1e6;
+    }
+
+    qsort(spawn, f->count, sizeof(*spawn), compare_doubles);
+    qsort(lifetime, f->count, sizeof(*lifetime), compare_doubles);
+
+    double total = 0;
+    for (size_t i = 0; i < f->count; i++) {
+        total += spawn[i];
+    }
+
+    fprintf(out, "%zu children via %s, %s reaping, %.0f spawns/s\n",
+            f->count, method_names[f->method], f->epoll_fd != -1 ? "pidfd" : "signalfd",
+            f->count / (total / 1e6));
+    fprintf(out, "%-12s %10s %10s %10s %10s\n", "[us]", "p50", "p90", "p99", "max");
+    fprintf(out, "%-12s %10.1f %10.1f %10.1f %10.1f\n", "spawn",
+            percentile(spawn, f->count, 0.5), percentile(spawn, f->count, 0.9),
+            percentile(spawn, f->count, 0.99), spawn[f->count - 1]);
+    fprintf(out, "%-12s %10.1f %10.1f %10.1f %10.1f\n", "exit",
+            percentile(lifetime, f->count, 0.5), percentile(lifetime, f->count, 0.9),
+            percentile(lifetime, f->count, 0.99), lifetime[f->count - 1]);
+
+    free(spawn);
+    free(lifetime);
+}
+
+void fanout_free(fanout *f) {
+    for (size_t i = 0; i < f->count; i++) {
+        if (f->children[i].pidfd != -1) {
+            close(f->children[i].pidfd);
+        }
+    }
+
+    if (f->epoll_fd != -1) {
+        close(f->epoll_fd);
+    }
+
+    if (f->signal_fd != -1) {
+        close(f->signal_fd);
+        sigprocmask(SIG_SETMASK, &f->child_mask, NULL);
+    }
+
+    free(f->children);
+    free(f->unwatched);
+    free(f->clone_stack);
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+
+typedef enum {
+    FANOUT_FORK,  //plain fork, child runs fn
+    FANOUT_CLONE, //clone(CLONE_VM | CLONE_VFORK), fn runs on a private stack and must stick to async-signal-safe calls
+    FANOUT_SPAWN  //posix_spawn of argv, no page tables get copied
+} fanout_method;
+
+typedef int (*fanout_fn)(void *arg);
+
+typedef struct {
+    pid_t pid;
+    int pidfd;
+    struct timespec started;
+    //seconds spent inside the spawning call
+    double spawn_latency;
+    //seconds from the spawning call until the child got reaped
+    double lifetime;
+    int wstatus;
+} fanout_child;
+
+typedef struct {
+    fanout_method method;
+    fanout_child *children;
+    size_t count;
+    size_t capacity;
+    size_t running;
+    //pidfds of running children, -1 if the kernel has no pidfd_open
+    int epoll_fd;
+    //indices of children whose pidfd couldn't be had (EMFILE with many children), polled with waitpid
+    size_t *unwatched;
+    size_t unwatched_count;
+    size_t unwatched_capacity;
+    //SIGCHLD fallback, -1 when pidfds are in use
+    int signal_fd;
+    sigset_t child_mask;
+    char *clone_stack;
+} fanout;
+
+bool fanout_init(fanout *f, fanout_method method);
+pid_t fanout_start(fanout *f, fanout_fn fn, void *arg, char *const spawn_argv[], char *const spawn_envp[]);
+size_t fanout_reap(fanout *f, int timeout_ms);
+void fanout_wait_all(fanout *f);
+void fanout_report(fanout *f, FILE *out);
+void fanout_free(fanout *f);
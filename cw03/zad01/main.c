@@ -1,17 +1,56 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <string.h>
+#include <stdbool.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
+#include "fanout.h"
+
+extern char **environ;
+const char* PRIV_ENV_VAR = "_CW03_ZAD01_CHILD_IDX";
+
+int say_hello(void *arg);
+
 int main(int argc, char **argv) {
-    if (argc != 2) {
+    //posix_spawned children come back here with their index in the environment
+    char *spawned_idx = getenv(PRIV_ENV_VAR);
+    if (spawned_idx) {
+        size_t idx = strtoul(spawned_idx, NULL, 10);
+        return say_hello(&idx);
+    }
+
+    fanout_method method = FANOUT_FORK;
+    bool report = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "m:s")) != -1) {
+        if (opt == 'm' && strcmp(optarg, "fork") == 0) {
+            method = FANOUT_FORK;
+        }
+        else if (opt == 'm' && strcmp(optarg, "clone") == 0) {
+            method = FANOUT_CLONE;
+        }
+        else if (opt == 'm' && strcmp(optarg, "spawn") == 0) {
+            method = FANOUT_SPAWN;
+        }
+        else if (opt == 's') {
+            report = true;
+        }
+        else {
+            fprintf(stderr, "usage: %s [-m fork|clone|spawn] [-s] child_count\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (argc - optind != 1) {
         fprintf(stderr, "invalid argument count\n");
         return EXIT_FAILURE;
     }
     
     size_t child_count;
-    if (sscanf(argv[1], "%zu", &child_count) != 1) {
+    if (sscanf(argv[optind], "%zu", &child_count) != 1) {
         fprintf(stderr, "malformed parameter\n");
         return EXIT_FAILURE;
     }
@@ -20,14 +59,85 @@ int main(int argc, char **argv) {
         return EXIT_FAILURE;
     }
 
+    fanout workers;
+    if (!fanout_init(&workers, method)) {
+        return EXIT_FAILURE;
+    }
+
+    //spawned children re-exec ourselves, the last environment slot carries their index
+    size_t env_count = 0;
+    while (environ[env_count]) {
+        env_count++;
+    }
+
+    char **spawn_envp = malloc((env_count + 2) * sizeof(*spawn_envp));
+    memcpy(spawn_envp, environ, env_count * sizeof(*spawn_envp));
+    spawn_envp[env_count + 1] = NULL;
+
+    char idx_var[64];
+    spawn_envp[env_count] = idx_var;
+    char *spawn_argv[] = { "/proc/self/exe", NULL };
+
     for (size_t i = 0; i < child_count; i++) {
-        if (fork() == 0) {
-            printf("hello from child %zu with pid %d\n", i, getpid());
-            return EXIT_SUCCESS;
+        snprintf(idx_var, sizeof(idx_var), "%s=%zu", PRIV_ENV_VAR, i);
+
+        //children may only read i before they are started, clone and spawn wait for that anyway
+        size_t idx = i;
+        if (fanout_start(&workers, say_hello, &idx, spawn_argv, spawn_envp) == -1) {
+            break;
         }
+
+        //keep the zombie count low while spawning
+        fanout_reap(&workers, 0);
     }
 
     //consume zombies, wait for all children to finish
-    while (wait(NULL) > 0)
-        ;
+    fanout_wait_all(&workers);
+
+    if (report) {
+        fanout_report(&workers, stderr);
+    }
+
+    fanout_free(&workers);
+    free(spawn_envp);
+}
+
+//appends the decimal digits of value, snprintf isn't async-signal-safe
+size_t append_uint(char *buf, size_t len, size_t value) {
+    char digits[24];
+    size_t count = 0;
+
+    do {
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+
+    while (count > 0) {
+        buf[len++] = digits[--count];
+    }
+
+    return len;
+}
+
+size_t append_str(char *buf, size_t len, const char *s) {
+    while (*s) {
+        buf[len++] = *s++;
+    }
+
+    return len;
+}
+
+//runs in a clone sharing our memory, so no stdio here, only async-signal-safe calls
+int say_hello(void *arg) {
+    char buf[128];
+    size_t len = 0;
+
+    len = append_str(buf, len, "hello from child ");
+    len = append_uint(buf, len, *(size_t *)arg);
+    len = append_str(buf, len, " with pid ");
+    len = append_uint(buf, len, getpid());
+    len = append_str(buf, len, "\n");
+
+    write(STDOUT_FILENO, buf, len);
+    return EXIT_SUCCESS;
 }
@@ -5,13 +5,67 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/times.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
 
 #include <rrmerge.h>
 
+typedef struct {
+    size_t offset;
+    size_t len;
+    bool done;
+} merge_result;
+
+/**
+ * shared between all children, which reserve space for their rows with a single fetch_add,
+ * the mapping keeps its address across fork so the pointers stay valid
+ */
+typedef struct {
+    atomic_size_t used;
+    size_t capacity;
+    merge_result *results;
+    char *data;
+} result_arena;
+
+result_arena *arena_create(int pair_count, char **path_pairs);
+bool arena_store(result_arena *arena, int pair_idx, v_char *row_block);
+size_t arena_collect(result_arena *arena, int pair_count, v_v_char *row_blocks);
+size_t path_pair_size(const char *path_pair);
+
+typedef struct {
+    int pair_idx;
+    size_t size;
+    pid_t pid;
+    //user + sys time of the finished child
+    double cpu;
+} merge_job;
+
+void run_merge_job(result_arena *arena, int pair_idx, char *path_pair);
+int compare_jobs_by_size(const void *a, const void *b);
+double seconds_between(const struct timespec *start, const struct timespec *end);
+
 int main(int argc, char **argv) {
     struct tms tms_measure_start;
     clock_t real_measure_start = times(&tms_measure_start);
 
+    long job_limit = sysconf(_SC_NPROCESSORS_ONLN);
+
+    int opt;
+    while ((opt = getopt(argc, argv, "j:")) != -1) {
+        if (opt != 'j' || sscanf(optarg, "%ld", &job_limit) != 1 || job_limit < 1) {
+            fprintf(stderr, "usage: %s [-j jobs] path_a:path_b...\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    //from now on argv[1] is the first path pair
+    argc -= optind - 1;
+    argv += optind - 1;
+
     for (int i = 1; i < argc; i++) {
         if (strchr(argv[i], ':') == NULL) {
             fprintf(stderr, "argument %d is malformed\n", i - 1);
@@ -19,37 +73,89 @@ int main(int argc, char **argv) {
         }
     }
 
-    //init structures once, work on their copies in child processes
+    //filled from the shared arena once children are done
     v_v_char row_blocks;
-    v_file_pair file_pairs;
-    v_FILE tmp_files;
-
     vec_init(&row_blocks);
-    vec_init(&file_pairs);
-    vec_init(&tmp_files);
 
-    for (int i = 1; i < argc; i++) {
-        if (fork() == 0) {
-            add_file_pair(&file_pairs, argv[i]);
-            merge_file_pairs(&tmp_files, &file_pairs);
-            add_row_block(&row_blocks, tmp_files.storage[0]);
-
-            free_row_blocks(&row_blocks);
-            free_file_pairs(&file_pairs);
-            free_tmp_files(&tmp_files);
-            return EXIT_SUCCESS;
+    result_arena *arena = arena_create(argc - 1, &argv[1]);
+    if (!arena) {
+        return EXIT_FAILURE;
+    }
+
+    //largest pairs go first, so no big one is left running alone at the end
+    size_t job_count = argc - 1;
+    merge_job *jobs = calloc(job_count, sizeof(*jobs));
+    for (size_t i = 0; i < job_count; i++) {
+        jobs[i].pair_idx = i;
+        jobs[i].size = path_pair_size(argv[i + 1]);
+    }
+    qsort(jobs, job_count, sizeof(*jobs), compare_jobs_by_size);
+
+    struct timespec wall_start;
+    struct timespec wall_end;
+    clock_gettime(CLOCK_MONOTONIC, &wall_start);
+
+    size_t next_job = 0;
+    size_t running = 0;
+
+    while (next_job < job_count || running > 0) {
+        while (next_job < job_count && running < (size_t)job_limit) {
+            merge_job *job = &jobs[next_job++];
+
+            job->pid = fork();
+            if (job->pid == 0) {
+                run_merge_job(arena, job->pair_idx, argv[job->pair_idx + 1]);
+            }
+            else if (job->pid == -1) {
+                perror("fork");
+                continue;
+            }
+
+            running++;
+        }
+
+        //consume a zombie, its slot goes to the next job right away
+        struct rusage usage;
+        pid_t pid = wait4(-1, NULL, 0, &usage);
+        if (pid == -1) {
+            break;
+        }
+
+        running--;
+
+        for (size_t i = 0; i < next_job; i++) {
+            if (jobs[i].pid == pid) {
+                jobs[i].cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+                            + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+                break;
+            }
         }
     }
-    
-    //consume zombies, wait for all children to finish
-    while (wait(NULL) > 0)
-        ;
 
-    //formal calls in case these vectors were preinitialized (they are not)
-    ///in fact these structures were filled with data only in child processes
+    clock_gettime(CLOCK_MONOTONIC, &wall_end);
+
+    /**
+     * what running the jobs one after another would roughly cost,
+     * cpu time unlike per-job wall time does not grow with the number of jobs competing for cores
+     */
+    double serial = 0;
+    for (size_t i = 0; i < job_count; i++) {
+        serial += jobs[i].cpu;
+    }
+    double wall = seconds_between(&wall_start, &wall_end);
+
+    printf("%zu jobs, %ld at a time: wall %.3fs, serial %.3fs, speedup %.2fx\n",
+           job_count, job_limit, wall, serial, wall > 0 ? serial / wall : 0);
+
+    free(jobs);
+
+    //rows merged by children, in argument order, without touching the files again
+    size_t row_count = arena_collect(arena, argc - 1, &row_blocks);
+    printf("collected %zu row blocks, %zu rows\n", row_blocks.size, row_count);
+
+    munmap(arena, sizeof(*arena) + (argc - 1) * sizeof(*arena->results) + arena->capacity);
+
     free_row_blocks(&row_blocks);
-    free_file_pairs(&file_pairs);
-    free_tmp_files(&tmp_files);
 
     struct tms tms_measure_end;
     clock_t real_measure_end = times(&tms_measure_end);
@@ -61,3 +167,138 @@ int main(int argc, char **argv) {
     printf("measured time: real, user, sys\n");
     printf("%ld %ld %ld\n", real_elapsed, user_elapsed, system_elapsed);
 }
+
+result_arena *arena_create(int pair_count, char **path_pairs) {
+    //merging only interleaves lines, so the output of a pair is exactly as big as its inputs
+    size_t capacity = 0;
+    for (int i = 0; i < pair_count; i++) {
+        capacity += path_pair_size(path_pairs[i]);
+    }
+
+    size_t results_size = pair_count * sizeof(merge_result);
+    size_t total_size = sizeof(result_arena) + results_size + capacity;
+
+    result_arena *arena = mmap(NULL, total_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED) {
+        perror("mmap");
+        return NULL;
+    }
+
+    //fresh anonymous mapping is zeroed, so all results start as not done
+    atomic_init(&arena->used, 0);
+    arena->capacity = capacity;
+    arena->results = (merge_result *)&arena[1];
+    arena->data = (char *)&arena->results[pair_count];
+
+    return arena;
+}
+
+bool arena_store(result_arena *arena, int pair_idx, v_char *row_block) {
+    size_t len = 0;
+    for (size_t i = 0; i < row_block->size; i++) {
+        len += strlen(row_block->storage[i]);
+    }
+
+    size_t offset = atomic_fetch_add(&arena->used, len);
+    if (offset + len > arena->capacity) {
+        fprintf(stderr, "pair %d grew while merging, result dropped\n", pair_idx);
+        return false;
+    }
+
+    char *dest = &arena->data[offset];
+    for (size_t i = 0; i < row_block->size; i++) {
+        size_t row_len = strlen(row_block->storage[i]);
+        memcpy(dest, row_block->storage[i], row_len);
+        dest += row_len;
+    }
+
+    merge_result *result = &arena->results[pair_idx];
+    result->offset = offset;
+    result->len = len;
+    result->done = true;
+
+    return true;
+}
+
+//rows are split on newlines again, the same way getline split the merged file
+size_t arena_collect(result_arena *arena, int pair_count, v_v_char *row_blocks) {
+    size_t row_count = 0;
+
+    for (int i = 0; i < pair_count; i++) {
+        merge_result *result = &arena->results[i];
+        if (!result->done) {
+            continue;
+        }
+
+        v_char *row_block = malloc(sizeof(*row_block));
+        vec_init(row_block);
+
+        char *row = &arena->data[result->offset];
+        char *end = row + result->len;
+
+        while (row < end) {
+            char *newline = memchr(row, '\n', end - row);
+            char *row_end = newline ? newline + 1 : end;
+
+            vec_push_back(row_block, strndup(row, row_end - row));
+            row = row_end;
+        }
+
+        row_count += row_block->size;
+        vec_push_back(row_blocks, row_block);
+    }
+
+    return row_count;
+}
+
+size_t path_pair_size(const char *path_pair) {
+    char *colon_ptr = strchr(path_pair, ':');
+    char *path_a = strndup(path_pair, colon_ptr - path_pair);
+    size_t size = 0;
+
+    struct stat st;
+    if (stat(path_a, &st) == 0) {
+        size += st.st_size;
+    }
+    if (stat(&colon_ptr[1], &st) == 0) {
+        size += st.st_size;
+    }
+
+    free(path_a);
+    return size;
+}
+
+void run_merge_job(result_arena *arena, int pair_idx, char *path_pair) {
+    v_v_char row_blocks;
+    v_file_pair file_pairs;
+    v_FILE tmp_files;
+
+    vec_init(&row_blocks);
+    vec_init(&file_pairs);
+    vec_init(&tmp_files);
+
+    add_file_pair(&file_pairs, path_pair);
+    merge_file_pairs(&tmp_files, &file_pairs);
+
+    bool stored = false;
+    if (tmp_files.size > 0) {
+        add_row_block(&row_blocks, tmp_files.storage[0]);
+        stored = arena_store(arena, pair_idx, row_blocks.storage[0]);
+    }
+
+    free_row_blocks(&row_blocks);
+    free_file_pairs(&file_pairs);
+    free_tmp_files(&tmp_files);
+    exit(stored ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+int compare_jobs_by_size(const void *a, const void *b) {
+    const merge_job *lhs = a;
+    const merge_job *rhs = b;
+
+    return (lhs->size < rhs->size) - (lhs->size > rhs->size);
+}
+
+double seconds_between(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
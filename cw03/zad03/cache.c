@@ -0,0 +1,297 @@
+#include "cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+
+#define CACHE_MAGIC 0x6863726165735f63ULL //"c_search" read little endian
+#define INITIAL_CAPACITY (1 << 16)
+#define MAX_PROBE 64
+
+struct cache_header {
+    uint64_t magic;
+    uint64_t capacity;
+    _Atomic uint64_t count;
+    //stores that found no slot within MAX_PROBE, the next table is sized to take them too
+    _Atomic uint64_t dropped;
+};
+
+/**
+ * key 0 marks an empty slot, slots are claimed with a cas on the key and never released
+ * 
+ * the rest is guarded by a seqlock: seq is odd while a writer is inside,
+ * readers retry (or give up) when it changes under them
+ */
+struct cache_entry {
+    _Atomic uint64_t key;
+    uint64_t mtime_ns;
+    uint64_t size;
+    _Atomic uint32_t seq;
+    uint32_t matched;
+};
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static uint64_t hash_string(const char *s) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (; *s; s++) {
+        hash = (hash ^ (unsigned char)*s) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static uint64_t entry_key(search_cache *cache, const struct stat *st) {
+    uint64_t key = mix64(mix64(st->st_dev ^ cache->needle_hash) ^ st->st_ino);
+    return key == 0 ? 1 : key;
+}
+
+static uint64_t mtime_ns(const struct stat *st) {
+    return (uint64_t)st->st_mtim.tv_sec * 1000000000ULL + st->st_mtim.tv_nsec;
+}
+
+static size_t map_size_for(uint64_t capacity) {
+    return sizeof(cache_header) + capacity * sizeof(cache_entry);
+}
+
+/**
+ * writes a fresh table with the given capacity next to path, carrying over consistent entries
+ * of the old one if there is any, then renames it into place, so readers never see a half-built file
+ */
+static bool cache_rebuild(const char *path, uint64_t capacity, cache_header *old_header, cache_entry *old_entries) {
+    size_t tmp_len = strlen(path) + 8;
+    char *tmp_path = malloc(tmp_len);
+    snprintf(tmp_path, tmp_len, "%s.XXXXXX", path);
+
+    int fd = mkstemp(tmp_path);
+    if (fd == -1) {
+        perror(tmp_path);
+        free(tmp_path);
+        return false;
+    }
+
+    size_t size = map_size_for(capacity);
+    cache_header *header = MAP_FAILED;
+
+    if (ftruncate(fd, size) == 0) {
+        header = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+
+    if (header == MAP_FAILED) {
+        perror(tmp_path);
+        close(fd);
+        unlink(tmp_path);
+        free(tmp_path);
+        return false;
+    }
+
+    header->magic = CACHE_MAGIC;
+    header->capacity = capacity;
+    atomic_init(&header->count, 0);
+    atomic_init(&header->dropped, 0);
+
+    cache_entry *entries = (cache_entry *)&header[1];
+    uint64_t mask = capacity - 1;
+
+    for (uint64_t i = 0; old_header && i < old_header->capacity; i++) {
+        cache_entry *old = &old_entries[i];
+        uint64_t key = atomic_load(&old->key);
+        uint32_t seq = atomic_load(&old->seq);
+
+        if (key == 0 || seq % 2 == 1) {
+            continue;
+        }
+
+        uint64_t probe = 0;
+        for (; probe < MAX_PROBE; probe++) {
+            cache_entry *entry = &entries[(key + probe) & mask];
+            if (atomic_load(&entry->key) == 0) {
+                atomic_store(&entry->key, key);
+                entry->mtime_ns = old->mtime_ns;
+                entry->size = old->size;
+                entry->matched = old->matched;
+                //even and nonzero, a filled in entry as far as lookups are concerned
+                atomic_store(&entry->seq, 2);
+                atomic_fetch_add(&header->count, 1);
+                break;
+            }
+        }
+
+        if (probe == MAX_PROBE) {
+            atomic_fetch_add(&header->dropped, 1);
+        }
+    }
+
+    munmap(header, size);
+    close(fd);
+
+    bool renamed = rename(tmp_path, path) == 0;
+    if (!renamed) {
+        perror(path);
+        unlink(tmp_path);
+    }
+
+    free(tmp_path);
+    return renamed;
+}
+
+static bool cache_map(search_cache *cache) {
+    int fd = open(cache->path, O_RDWR | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat st;
+    cache_header header;
+
+    bool valid = fstat(fd, &st) == 0
+              && (size_t)st.st_size >= sizeof(header)
+              && pread(fd, &header, sizeof(header), 0) == sizeof(header)
+              && header.magic == CACHE_MAGIC
+              && header.capacity > 0 && (header.capacity & (header.capacity - 1)) == 0
+              && (size_t)st.st_size == map_size_for(header.capacity);
+
+    if (valid) {
+        cache->map_size = st.st_size;
+        cache->header = mmap(NULL, cache->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        valid = cache->header != MAP_FAILED;
+    }
+
+    close(fd);
+
+    if (!valid) {
+        cache->header = NULL;
+        return false;
+    }
+
+    cache->entries = (cache_entry *)&cache->header[1];
+    return true;
+}
+
+bool cache_open(search_cache *cache, const char *path, const char *needle) {
+    cache->path = strdup(path);
+    cache->needle_hash = hash_string(needle);
+    cache->header = NULL;
+
+    //missing or foreign files are replaced with an empty table
+    if (!cache_map(cache)) {
+        if (!cache_rebuild(path, INITIAL_CAPACITY, NULL, NULL) || !cache_map(cache)) {
+            fprintf(stderr, "%s: cache unusable, searching without it\n", path);
+            free(cache->path);
+            cache->path = NULL;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+cache_result cache_lookup(search_cache *cache, const struct stat *st) {
+    uint64_t key = entry_key(cache, st);
+    uint64_t mask = cache->header->capacity - 1;
+
+    for (uint64_t probe = 0; probe < MAX_PROBE; probe++) {
+        cache_entry *entry = &cache->entries[(key + probe) & mask];
+        uint64_t entry_key = atomic_load(&entry->key);
+
+        if (entry_key == 0) {
+            return CACHE_MISS;
+        }
+
+        if (entry_key != key) {
+            continue;
+        }
+
+        uint32_t seq = atomic_load_explicit(&entry->seq, memory_order_acquire);
+        if (seq % 2 == 1) {
+            return CACHE_MISS;
+        }
+
+        uint64_t entry_mtime = entry->mtime_ns;
+        uint64_t entry_size = entry->size;
+        uint32_t matched = entry->matched;
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&entry->seq, memory_order_relaxed) != seq) {
+            return CACHE_MISS;
+        }
+
+        //a fresh entry (seq 0) was claimed but has never been filled in
+        if (seq == 0 || entry_mtime != mtime_ns(st) || entry_size != (uint64_t)st->st_size) {
+            return CACHE_MISS;
+        }
+
+        return matched ? CACHE_MATCH : CACHE_NO_MATCH;
+    }
+
+    return CACHE_MISS;
+}
+
+void cache_store(search_cache *cache, const struct stat *st, bool matched) {
+    uint64_t key = entry_key(cache, st);
+    uint64_t mask = cache->header->capacity - 1;
+
+    for (uint64_t probe = 0; probe < MAX_PROBE; probe++) {
+        cache_entry *entry = &cache->entries[(key + probe) & mask];
+
+        uint64_t expected = 0;
+        if (atomic_compare_exchange_strong(&entry->key, &expected, key)) {
+            atomic_fetch_add(&cache->header->count, 1);
+        }
+        else if (expected != key) {
+            continue;
+        }
+
+        //whoever else is writing this entry right now wins, it's just a cache
+        uint32_t seq = atomic_load(&entry->seq);
+        if (seq % 2 == 1 || !atomic_compare_exchange_strong(&entry->seq, &seq, seq + 1)) {
+            return;
+        }
+
+        entry->mtime_ns = mtime_ns(st);
+        entry->size = st->st_size;
+        entry->matched = matched;
+
+        atomic_store_explicit(&entry->seq, seq + 2, memory_order_release);
+        return;
+    }
+
+    //too crowded around this key, counted so the table grows enough on close
+    atomic_fetch_add(&cache->header->dropped, 1);
+}
+
+void cache_close(search_cache *cache) {
+    if (!cache->header) {
+        return;
+    }
+
+    /**
+     * keep the load under 3/4 so probe sequences stay short, sized by what this run wanted to store
+     * rather than by what fit, a big tree is then fully cached after a single cold run
+     */
+    uint64_t capacity = cache->header->capacity;
+    uint64_t demand = atomic_load(&cache->header->count) + atomic_load(&cache->header->dropped);
+
+    if (demand * 4 >= capacity * 3) {
+        uint64_t grown = capacity;
+        while (demand * 4 >= grown * 3) {
+            grown *= 2;
+        }
+
+        cache_rebuild(cache->path, grown, cache->header, cache->entries);
+    }
+
+    munmap(cache->header, cache->map_size);
+    free(cache->path);
+    cache->header = NULL;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+
+typedef enum {
+    CACHE_MISS,
+    CACHE_MATCH,
+    CACHE_NO_MATCH
+} cache_result;
+
+typedef struct cache_header cache_header;
+typedef struct cache_entry cache_entry;
+
+/**
+ * persistent open addressing table of search results, mapped shared so that
+ * threads and concurrently running searches all update it in place
+ */
+typedef struct {
+    char *path;
+    cache_header *header;
+    cache_entry *entries;
+    size_t map_size;
+    uint64_t needle_hash;
+} search_cache;
+
+bool cache_open(search_cache *cache, const char *path, const char *needle);
+cache_result cache_lookup(search_cache *cache, const struct stat *st);
+void cache_store(search_cache *cache, const struct stat *st, bool matched);
+void cache_close(search_cache *cache);
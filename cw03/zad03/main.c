@@ -1,5 +1,3 @@
-#define _GNU_SOURCE //enable asprintf
-
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -7,17 +5,54 @@
 #include <stdbool.h>
 #include <sys/types.h>
 #include <sys/stat.h>
-#include <sys/wait.h>
 #include <fcntl.h>
-#include <dirent.h>
 #include <errno.h>
+#include <stdatomic.h>
+
+#include "walker.h"
+#include "search.h"
+#include "cache.h"
+#include "uring.h"
+
+typedef struct {
+    const char *needle;
+    size_t needle_len;
+    //indexed by worker id
+    search_buffer *buffers;
+    //NULL unless a cache file was given
+    search_cache *cache;
+    //-1 unless io_uring was asked for, rings are set up lazily by their workers
+    int root_fd;
+    uring_search **rings;
+    atomic_bool uring_failed;
+} search_args;
+
+void search_file(size_t worker_id, int dir_fd, const char *name, const char *path, void *arg);
+void file_searched(size_t worker_id, const char *path, bool found, const struct stat *st, void *arg);
 
-extern char **environ;
-const char* PRIV_ENV_VAR = "_CW03_ZAD03_RECURSIVE_EXEC";
+int main(int argc, char **argv) {
+    long worker_count = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *cache_path = NULL;
+    bool use_uring = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:c:u")) != -1) {
+        if (opt == 'c') {
+            cache_path = optarg;
+        }
+        else if (opt == 'u') {
+            use_uring = true;
+        }
+        else if (opt != 't' || sscanf(optarg, "%ld", &worker_count) != 1 || worker_count < 1) {
+            fprintf(stderr, "usage: %s [-t threads] [-c cache_file] [-u] dir needle depth\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
 
-bool kmp_file_contains(FILE *file, const char *needle);
+    //from now on argv[1] is the directory
+    argc -= optind - 1;
+    argv += optind - 1;
 
-int main(int argc, char **argv) {
     if (argc != 4) {
         fprintf(stderr, "invalid argument count\n");
         return EXIT_FAILURE;
@@ -29,167 +64,123 @@ int main(int argc, char **argv) {
         return EXIT_FAILURE;
     }
 
-    //we don't want the dot in paths printed out to the user
-    const char *dir_path;
-    const char *dir_path_no_dot;
+    /**
+     * one process, a pool of workers stealing directories from each other,
+     * paths are printed relative to argv[1] and prefixed with the worker id
+     */
+    search_args args = {
+        .needle = argv[2],
+        .needle_len = strlen(argv[2]),
+        .buffers = calloc(worker_count, sizeof(search_buffer)),
+        .root_fd = -1
+    };
+    atomic_init(&args.uring_failed, false);
+
+    //with -u every worker keeps a batch of files in flight instead of reading them one by one
+    if (use_uring) {
+        args.root_fd = open(argv[1], O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        args.rings = calloc(worker_count, sizeof(uring_search *));
+    }
 
-    //detect initial call, change working dir to argv[1] so we can build relative paths properly
-    if (getenv(PRIV_ENV_VAR)) {
-        dir_path_no_dot = argv[1];
-        dir_path = argv[1];
+    //results of unchanged files are taken from the cache without opening them
+    search_cache cache;
+    if (cache_path && cache_open(&cache, cache_path, argv[2])) {
+        args.cache = &cache;
     }
-    else {
-        if (chdir(argv[1]) == -1) {
-            perror(argv[1]);
-            return EXIT_FAILURE;
+
+    bool walked = walk_tree(argv[1], depth, worker_count, ".txt", search_file, &args);
+
+    //whatever is still in flight completes here, on behalf of the worker that submitted it
+    if (args.rings) {
+        for (long i = 0; i < worker_count; i++) {
+            if (args.rings[i]) {
+                uring_search_finish(args.rings[i]);
+            }
         }
-        dir_path_no_dot = "";
-        dir_path = "./";
-        setenv(PRIV_ENV_VAR, "", 1);
+        free(args.rings);
     }
 
-    //we'll exec ourselves recursively using fexecve, because we shouldn't rely on argv[0]
-    int self_executable_fd = open("/proc/self/exe", O_RDONLY | O_CLOEXEC);
-    if (self_executable_fd == -1) {
-        fprintf(stderr, "can't replicate, wt?f\n");
+    if (args.root_fd != -1) {
+        close(args.root_fd);
     }
 
-    /**
-     * open directory through fd so we can specify O_CLOEXEC to
-     * prevent propagation of unecessary fd's into forks
-     */
-    int dir_fd = open(dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
-    if (dir_fd == -1) {
-        perror(dir_path);
-        return EXIT_FAILURE;
+    if (args.cache) {
+        cache_close(args.cache);
     }
 
-    DIR *dir = fdopendir(dir_fd);
-
-    struct dirent *curr_dirent;
-    while ((curr_dirent = readdir(dir))) {
-        if (strcmp(".", curr_dirent->d_name) == 0) continue;
-        if (strcmp("..", curr_dirent->d_name) == 0) continue;
-
-        if (curr_dirent->d_type == DT_REG) {
-            char *dot = strrchr(curr_dirent->d_name, '.');
-
-            if (dot && strcmp(".txt", dot) == 0) {
-                char *file_path;
-                asprintf(&file_path, "%s%s", dir_path_no_dot, curr_dirent->d_name);
+    for (long i = 0; i < worker_count; i++) {
+        search_buffer_free(&args.buffers[i]);
+    }
+    free(args.buffers);
 
-                FILE *file = fopen(file_path, "r");
-                if (file) {
-                    if (kmp_file_contains(file, argv[2])) {
-                        printf("%d: %s\n", getpid(), file_path);
-                    }
+    return walked ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 
-                    fclose(file);
-                }
-                else {
-                    perror(file_path);
-                }
+void search_file(size_t worker_id, int dir_fd, const char *name, const char *path, void *arg) {
+    search_args *args = arg;
+    struct stat st;
 
-                free(file_path);
-            }
+    if (args->cache) {
+        if (fstatat(dir_fd, name, &st, 0) == -1) {
+            perror(path);
+            return;
         }
-        else if (curr_dirent->d_type == DT_DIR && depth > 0) {
-            char *subdir_path;
-            asprintf(&subdir_path, "%s%s/", dir_path_no_dot, curr_dirent->d_name);
-
-            char new_depth_str[20 + 1]; //ceil(log10(2^64)) + nullchar
-            sprintf(new_depth_str, "%zu", depth - 1);
-
-            char *newargv[] = { argv[0], subdir_path, argv[2], new_depth_str, NULL };
-
-            //flush these files, so they won't be accidentaly duplicated in forks
-            fflush(stdout);
-            fflush(stderr);
-
-            /**
-             * recursive execs go brrr
-             * 
-             * to be able to close current directory in the fork, we must be in a real fork
-             * with working copy-on-write
-             * 
-             * in real use-case  this is a waste of time and we can fork
-             * using vfork to be less resource heavy, just memcheck won't be happy
-             * 
-             * in case of subdir_path, this is a guaranteed memleak in terms of memcheck,
-             * but it is also an argument of fexecve, so there is no way to free it
-             * 
-             * btw this program is not valgrindable for depth > 0, because
-             * self_executable_fd points to valgrind binary. lmao
-             * 
-             * environ is passed so PRIV_ENV_VAR can propagate with no effort
-             */
-            #ifdef MEMCHECK_HAPPY
-            if (fork() == 0) {
-                closedir(dir);
-
-                fexecve(self_executable_fd, newargv, environ);
-                _exit(EXIT_FAILURE); //in case exec fails for whatever reason
-            }
-            #else
-            if (vfork() == 0) {
-                //only exec and _exit calls are legal here
-                fexecve(self_executable_fd, newargv, environ);
-                _exit(EXIT_FAILURE); //in case exec fails for whatever reason
-            }
-            #endif
 
-            free(subdir_path);
+        cache_result cached = cache_lookup(args->cache, &st);
+        if (cached != CACHE_MISS) {
+            if (cached == CACHE_MATCH) {
+                printf("%zu: %s\n", worker_id, path);
+            }
+            return;
         }
     }
 
-    closedir(dir);
-
-    //consume zombies, wait for all children to finish
-    while (wait(NULL) > 0)
-        ;
-}
-
-bool kmp_file_contains(FILE *file, const char *needle) {
-    size_t needle_len = strlen(needle);
-    if (needle_len == 0) {
-        return true;
-    }
+    if (args->root_fd != -1 && !atomic_load(&args->uring_failed)) {
+        uring_search *ring = args->rings[worker_id];
 
-    size_t *prefix_fun = malloc(needle_len * sizeof(*prefix_fun));
-    size_t k = 0;
+        if (!ring) {
+            ring = uring_search_create(args->root_fd, args->needle, args->needle_len, worker_id, file_searched, args);
 
-    prefix_fun[0] = 0;
-    for (size_t q = 1; q < needle_len; q++) {
-        while (k > 0 && needle[k] != needle[q]) {
-            k = prefix_fun[k - 1];
+            //no io_uring in this kernel (or it's disabled), every worker falls back to plain reads
+            if (!ring && !atomic_exchange(&args->uring_failed, true)) {
+                fprintf(stderr, "io_uring unavailable, searching synchronously\n");
+            }
+            args->rings[worker_id] = ring;
         }
 
-        if (needle[k] == needle[q]) {
-            k++;
+        if (ring) {
+            uring_search_submit(ring, path, args->cache ? &st : NULL);
+            return;
         }
+    }
 
-        prefix_fun[q] = k;
+    int fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        perror(path);
+        return;
     }
 
-    size_t matches = 0;
-    char buf;
-    bool result = false;
+    bool found = search_fd(fd, args->needle, args->needle_len, &args->buffers[worker_id]);
+    if (found) {
+        printf("%zu: %s\n", worker_id, path);
+    }
 
-    while (fread(&buf, sizeof(buf), 1, file) == 1) {
-        while (matches > 0 && needle[matches] != buf) {
-            matches = prefix_fun[matches - 1];
-        }
+    //stat taken before reading, a file modified meanwhile just misses next time
+    if (args->cache) {
+        cache_store(args->cache, &st, found);
+    }
 
-        if (needle[matches] == buf) {
-            matches++;
-        }
+    close(fd);
+}
 
-        if (matches == needle_len) {
-            result = true;
-            break;
-        }
+void file_searched(size_t worker_id, const char *path, bool found, const struct stat *st, void *arg) {
+    search_args *args = arg;
+
+    if (found) {
+        printf("%zu: %s\n", worker_id, path);
     }
 
-    free(prefix_fun);
-    return result;
+    if (st) {
+        cache_store(args->cache, st, found);
+    }
 }
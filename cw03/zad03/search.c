@@ -0,0 +1,114 @@
+#define _GNU_SOURCE //enable memmem
+
+#include "search.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+
+//files up to this size are read in one go, bigger ones get mapped
+#define SMALL_FILE_SIZE (256 * 1024)
+
+static bool search_small(int fd, size_t size, const char *needle, size_t needle_len, search_buffer *buf) {
+    if (buf->capacity < size) {
+        free(buf->data);
+        buf->capacity = size;
+        buf->data = malloc(size);
+    }
+
+    size_t len = 0;
+    while (len < size) {
+        ssize_t n = read(fd, &buf->data[len], size - len);
+        if (n <= 0) {
+            break;
+        }
+        len += n;
+    }
+
+    return simd_memmem(buf->data, len, needle, needle_len) != NULL;
+}
+
+static bool search_mapped(int fd, size_t size, const char *needle, size_t needle_len, search_buffer *buf) {
+    char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    madvise(map, size, MADV_SEQUENTIAL);
+    bool found = simd_memmem(map, size, needle, needle_len) != NULL;
+
+    munmap(map, size);
+    return found;
+}
+
+bool search_fd(int fd, const char *needle, size_t needle_len, search_buffer *buf) {
+    if (needle_len == 0) {
+        return true;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < needle_len) {
+        return false;
+    }
+
+    if (st.st_size <= SMALL_FILE_SIZE) {
+        return search_small(fd, st.st_size, needle, needle_len, buf);
+    }
+
+    return search_mapped(fd, st.st_size, needle, needle_len, buf);
+}
+
+/**
+ * candidates are positions where both the first and the last byte of the needle match,
+ * 16 of them get checked at once and only those go through memcmp
+ */
+const char *simd_memmem(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len) {
+    if (needle_len == 0) {
+        return haystack;
+    }
+
+    if (needle_len > haystack_len) {
+        return NULL;
+    }
+
+    if (needle_len == 1) {
+        return memchr(haystack, needle[0], haystack_len);
+    }
+
+    size_t i = 0;
+
+#ifdef __SSE2__
+    __m128i first = _mm_set1_epi8(needle[0]);
+    __m128i last = _mm_set1_epi8(needle[needle_len - 1]);
+
+    for (; i + needle_len - 1 + 16 <= haystack_len; i += 16) {
+        __m128i block_first = _mm_loadu_si128((const __m128i *)&haystack[i]);
+        __m128i block_last = _mm_loadu_si128((const __m128i *)&haystack[i + needle_len - 1]);
+
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, block_first),
+                                                        _mm_cmpeq_epi8(last, block_last)));
+
+        while (mask) {
+            size_t candidate = i + __builtin_ctz(mask);
+            if (memcmp(&haystack[candidate + 1], &needle[1], needle_len - 2) == 0) {
+                return &haystack[candidate];
+            }
+
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    return memmem(&haystack[i], haystack_len - i, needle, needle_len);
+}
+
+void search_buffer_free(search_buffer *buf) {
+    free(buf->data);
+    buf->data = NULL;
+    buf->capacity = 0;
+}
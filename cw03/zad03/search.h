@@ -0,0 +1,13 @@
+#pragma once
+#include <stddef.h>
+#include <stdbool.h>
+
+//reusable read buffer, one per thread
+typedef struct {
+    char *data;
+    size_t capacity;
+} search_buffer;
+
+bool search_fd(int fd, const char *needle, size_t needle_len, search_buffer *buf);
+const char *simd_memmem(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len);
+void search_buffer_free(search_buffer *buf);
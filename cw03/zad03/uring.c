@@ -0,0 +1,362 @@
+#include "uring.h"
+#include "search.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+//files in flight per ring, each one takes three sqes and one registered file slot
+#define QUEUE_FILES 32
+#define RING_ENTRIES 128
+//whatever doesn't fit is searched synchronously after the first chunk misses
+#define READ_SIZE (256 * 1024)
+
+enum { OP_OPEN, OP_READ, OP_CLOSE };
+
+typedef struct {
+    char path[PATH_MAX];
+    char *buf;
+    struct stat st;
+    bool has_stat;
+    int open_res;
+    int read_res;
+    int pending;
+} uring_slot;
+
+struct uring_search {
+    int ring_fd;
+    int root_fd;
+    const char *needle;
+    size_t needle_len;
+    size_t worker_id;
+    uring_result_fn on_result;
+    void *arg;
+
+    void *sq_ptr;
+    void *cq_ptr;
+    size_t sq_size;
+    size_t cq_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    _Atomic unsigned *sq_head;
+    _Atomic unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned *sq_array;
+    unsigned sq_local_tail;
+    unsigned to_submit;
+
+    _Atomic unsigned *cq_head;
+    _Atomic unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+
+    uring_slot slots[QUEUE_FILES];
+    int free_slots[QUEUE_FILES];
+    size_t free_count;
+
+    search_buffer fallback_buf;
+};
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *params) {
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int io_uring_register(int ring_fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+}
+
+static bool ops_supported(int ring_fd) {
+    size_t probe_size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, probe_size);
+
+    bool supported = io_uring_register(ring_fd, IORING_REGISTER_PROBE, probe, 256) == 0
+                  && probe->last_op >= IORING_OP_CLOSE
+                  && probe->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED
+                  && probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED
+                  && probe->ops[IORING_OP_CLOSE].flags & IO_URING_OP_SUPPORTED;
+
+    free(probe);
+    return supported;
+}
+
+static struct io_uring_sqe *next_sqe(uring_search *u, int slot_idx, int op);
+
+//submits whatever is queued and takes the result of the one completion it waits for
+static int run_one(uring_search *u) {
+    atomic_store_explicit(u->sq_tail, u->sq_local_tail, memory_order_release);
+
+    int entered;
+    while ((entered = io_uring_enter(u->ring_fd, u->to_submit, 1, IORING_ENTER_GETEVENTS)) == -1 && errno == EINTR)
+        ;
+    u->to_submit = 0;
+
+    if (entered == -1) {
+        return -errno;
+    }
+
+    unsigned head = atomic_load_explicit(u->cq_head, memory_order_relaxed);
+    int res = u->cqes[head & u->cq_mask].res;
+    atomic_store_explicit(u->cq_head, head + 1, memory_order_release);
+
+    return res;
+}
+
+/**
+ * direct descriptors (file_index on openat and close) came in 5.15, an older kernel takes
+ * the very same sqe but ignores file_index and hands out a plain fd, so it's tried for real
+ */
+static bool direct_open_supported(uring_search *u) {
+    struct io_uring_sqe *sqe = next_sqe(u, 0, OP_OPEN);
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = u->root_fd;
+    sqe->addr = (unsigned long)".";
+    sqe->open_flags = O_RDONLY | O_DIRECTORY;
+    sqe->file_index = 1;
+
+    int res = run_one(u);
+    if (res > 0) {
+        close(res);
+    }
+    if (res != 0) {
+        return false;
+    }
+
+    sqe = next_sqe(u, 0, OP_CLOSE);
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->file_index = 1;
+
+    return run_one(u) == 0;
+}
+
+static void uring_unmap(uring_search *u) {
+    if (u->sqes && u->sqes != MAP_FAILED) munmap(u->sqes, u->sqes_size);
+    if (u->cq_ptr && u->cq_ptr != MAP_FAILED && u->cq_ptr != u->sq_ptr) munmap(u->cq_ptr, u->cq_size);
+    if (u->sq_ptr && u->sq_ptr != MAP_FAILED) munmap(u->sq_ptr, u->sq_size);
+}
+
+uring_search *uring_search_create(int root_fd, const char *needle, size_t needle_len, size_t worker_id, uring_result_fn on_result, void *arg) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    int ring_fd = io_uring_setup(RING_ENTRIES, &params);
+    if (ring_fd == -1) {
+        return NULL;
+    }
+
+    uring_search *u = calloc(1, sizeof(*u));
+    u->ring_fd = ring_fd;
+    u->root_fd = root_fd;
+    u->needle = needle;
+    u->needle_len = needle_len;
+    u->worker_id = worker_id;
+    u->on_result = on_result;
+    u->arg = arg;
+
+    u->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    u->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        u->sq_size = u->cq_size = u->sq_size > u->cq_size ? u->sq_size : u->cq_size;
+    }
+    u->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    u->sq_ptr = mmap(NULL, u->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    u->cq_ptr = params.features & IORING_FEAT_SINGLE_MMAP
+              ? u->sq_ptr
+              : mmap(NULL, u->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+
+    //direct descriptors let read and close be linked to the open that creates them
+    int files[QUEUE_FILES];
+    for (size_t i = 0; i < QUEUE_FILES; i++) {
+        files[i] = -1;
+    }
+
+    if (u->sq_ptr == MAP_FAILED || u->cq_ptr == MAP_FAILED || u->sqes == MAP_FAILED
+            || !ops_supported(ring_fd)
+            || io_uring_register(ring_fd, IORING_REGISTER_FILES, files, QUEUE_FILES) == -1) {
+        uring_unmap(u);
+        close(ring_fd);
+        free(u);
+        return NULL;
+    }
+
+    char *sq = u->sq_ptr;
+    u->sq_head = (_Atomic unsigned *)(sq + params.sq_off.head);
+    u->sq_tail = (_Atomic unsigned *)(sq + params.sq_off.tail);
+    u->sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+    u->sq_entries = *(unsigned *)(sq + params.sq_off.ring_entries);
+    u->sq_array = (unsigned *)(sq + params.sq_off.array);
+    u->sq_local_tail = atomic_load(u->sq_tail);
+
+    char *cq = u->cq_ptr;
+    u->cq_head = (_Atomic unsigned *)(cq + params.cq_off.head);
+    u->cq_tail = (_Atomic unsigned *)(cq + params.cq_off.tail);
+    u->cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    if (!direct_open_supported(u)) {
+        uring_unmap(u);
+        close(ring_fd);
+        free(u);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < QUEUE_FILES; i++) {
+        u->slots[i].buf = malloc(READ_SIZE);
+        u->free_slots[i] = QUEUE_FILES - 1 - i;
+    }
+    u->free_count = QUEUE_FILES;
+
+    return u;
+}
+
+static void finish_slot(uring_search *u, int slot_idx) {
+    uring_slot *slot = &u->slots[slot_idx];
+    bool found = false;
+
+    if (slot->open_res < 0 || slot->read_res < 0) {
+        errno = slot->open_res < 0 ? -slot->open_res : -slot->read_res;
+        perror(slot->path);
+    }
+    else {
+        found = simd_memmem(slot->buf, slot->read_res, u->needle, u->needle_len) != NULL;
+
+        //the first chunk missed but there may be more of the file
+        if (!found && slot->read_res == READ_SIZE) {
+            int fd = openat(u->root_fd, slot->path, O_RDONLY | O_CLOEXEC);
+            if (fd != -1) {
+                found = search_fd(fd, u->needle, u->needle_len, &u->fallback_buf);
+                close(fd);
+            }
+        }
+
+        u->on_result(u->worker_id, slot->path, found, slot->has_stat ? &slot->st : NULL, u->arg);
+    }
+
+    u->free_slots[u->free_count++] = slot_idx;
+}
+
+//submits everything queued and waits for at least min_complete completions
+static void submit_and_reap(uring_search *u, unsigned min_complete) {
+    atomic_store_explicit(u->sq_tail, u->sq_local_tail, memory_order_release);
+
+    while (io_uring_enter(u->ring_fd, u->to_submit, min_complete, IORING_ENTER_GETEVENTS) == -1) {
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            perror("io_uring_enter");
+            break;
+        }
+    }
+    u->to_submit = 0;
+
+    unsigned head = atomic_load_explicit(u->cq_head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(u->cq_tail, memory_order_acquire);
+
+    for (; head != tail; head++) {
+        struct io_uring_cqe *cqe = &u->cqes[head & u->cq_mask];
+        int slot_idx = cqe->user_data >> 2;
+        uring_slot *slot = &u->slots[slot_idx];
+
+        switch (cqe->user_data & 3) {
+            case OP_OPEN: slot->open_res = cqe->res; break;
+            case OP_READ: slot->read_res = cqe->res; break;
+        }
+
+        if (--slot->pending == 0) {
+            finish_slot(u, slot_idx);
+        }
+    }
+
+    atomic_store_explicit(u->cq_head, head, memory_order_release);
+}
+
+static struct io_uring_sqe *next_sqe(uring_search *u, int slot_idx, int op) {
+    unsigned idx = u->sq_local_tail & u->sq_mask;
+    struct io_uring_sqe *sqe = &u->sqes[idx];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = (unsigned long long)slot_idx << 2 | op;
+
+    u->sq_array[idx] = idx;
+    u->sq_local_tail++;
+    u->to_submit++;
+
+    return sqe;
+}
+
+void uring_search_submit(uring_search *u, const char *path, const struct stat *st) {
+    while (u->free_count == 0) {
+        submit_and_reap(u, 1);
+    }
+
+    //a chain has to go in whole
+    if (u->sq_local_tail - atomic_load_explicit(u->sq_head, memory_order_acquire) + 3 > u->sq_entries) {
+        submit_and_reap(u, 0);
+    }
+
+    int slot_idx = u->free_slots[--u->free_count];
+    uring_slot *slot = &u->slots[slot_idx];
+
+    snprintf(slot->path, sizeof(slot->path), "%s", path);
+    slot->has_stat = st != NULL;
+    if (st) {
+        slot->st = *st;
+    }
+    slot->open_res = 0;
+    slot->read_res = 0;
+    slot->pending = 3;
+
+    struct io_uring_sqe *open_sqe = next_sqe(u, slot_idx, OP_OPEN);
+    open_sqe->opcode = IORING_OP_OPENAT;
+    open_sqe->fd = u->root_fd;
+    open_sqe->addr = (unsigned long)slot->path;
+    open_sqe->open_flags = O_RDONLY;
+    open_sqe->file_index = slot_idx + 1;
+    open_sqe->flags = IOSQE_IO_LINK;
+
+    struct io_uring_sqe *read_sqe = next_sqe(u, slot_idx, OP_READ);
+    read_sqe->opcode = IORING_OP_READ;
+    read_sqe->fd = slot_idx;
+    read_sqe->addr = (unsigned long)slot->buf;
+    read_sqe->len = READ_SIZE;
+    read_sqe->off = 0;
+    //hardlink, so the slot gets closed even when the read fails
+    read_sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+
+    struct io_uring_sqe *close_sqe = next_sqe(u, slot_idx, OP_CLOSE);
+    close_sqe->opcode = IORING_OP_CLOSE;
+    close_sqe->file_index = slot_idx + 1;
+
+    //nothing to wait for yet, but keep the kernel busy once a batch is ready
+    if (u->to_submit >= QUEUE_FILES) {
+        submit_and_reap(u, 0);
+    }
+}
+
+//drains everything in flight and releases the ring
+void uring_search_finish(uring_search *u) {
+    while (u->free_count < QUEUE_FILES) {
+        submit_and_reap(u, 1);
+    }
+
+    for (size_t i = 0; i < QUEUE_FILES; i++) {
+        free(u->slots[i].buf);
+    }
+
+    search_buffer_free(&u->fallback_buf);
+    uring_unmap(u);
+    close(u->ring_fd);
+    free(u);
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+
+typedef struct uring_search uring_search;
+
+//st is NULL when the file was submitted without one
+typedef void (*uring_result_fn)(size_t worker_id, const char *path, bool found, const struct stat *st, void *arg);
+
+/**
+ * batched openat + read + close of many files in flight through one io_uring,
+ * files are opened relative to root_fd, so callers don't have to keep directories open
+ * 
+ * NULL when the kernel has no (usable) io_uring, callers should search synchronously then
+ */
+uring_search *uring_search_create(int root_fd, const char *needle, size_t needle_len, size_t worker_id, uring_result_fn on_result, void *arg);
+void uring_search_submit(uring_search *u, const char *path, const struct stat *st);
+void uring_search_finish(uring_search *u);
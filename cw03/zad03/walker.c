@@ -0,0 +1,324 @@
+#define _GNU_SOURCE //enable getdents64
+
+#include "walker.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+//queued directories keep their fd open only up to this many, the rest is reopened by path later
+#define MAX_QUEUED_FDS 256
+//getdents64 buffer of every worker, a few thousand entries per syscall
+#define DENTS_SIZE (256 * 1024)
+
+typedef struct {
+    int dir_fd; //-1 until opened relative to the root
+    size_t depth;
+    char *path;
+} walk_item;
+
+//ring buffer deque, the owner works on the bottom (depth first), thieves take from the top
+typedef struct {
+    walk_item *items;
+    size_t capacity;
+    size_t top;
+    size_t bottom;
+    pthread_mutex_t mutex;
+} walk_deque;
+
+typedef struct walk_state walk_state;
+
+typedef struct {
+    size_t id;
+    walk_state *state;
+    walk_deque deque;
+    pthread_t thread;
+    char *dents;
+    char path[PATH_MAX];
+} walk_worker;
+
+struct walk_state {
+    int root_fd;
+    walk_worker *workers;
+    size_t worker_count;
+    const char *suffix;
+    size_t suffix_len;
+    walk_file_fn on_file;
+    void *arg;
+
+    //directories pushed but not processed yet
+    atomic_size_t pending;
+    //directories sitting in deques
+    atomic_size_t queued;
+    atomic_size_t queued_fds;
+
+    pthread_mutex_t idle_mutex;
+    pthread_cond_t idle_cond;
+};
+
+static void deque_init(walk_deque *deque) {
+    deque->items = NULL;
+    deque->capacity = 0;
+    deque->top = 0;
+    deque->bottom = 0;
+    pthread_mutex_init(&deque->mutex, NULL);
+}
+
+static void deque_free(walk_deque *deque) {
+    free(deque->items);
+    pthread_mutex_destroy(&deque->mutex);
+}
+
+static void deque_push(walk_deque *deque, walk_item item) {
+    pthread_mutex_lock(&deque->mutex);
+
+    if (deque->bottom - deque->top == deque->capacity) {
+        size_t new_capacity = deque->capacity == 0 ? 64 : 2 * deque->capacity;
+        walk_item *items = malloc(new_capacity * sizeof(*items));
+
+        for (size_t i = deque->top; i < deque->bottom; i++) {
+            items[i - deque->top] = deque->items[i % deque->capacity];
+        }
+
+        free(deque->items);
+        deque->items = items;
+        deque->bottom -= deque->top;
+        deque->top = 0;
+        deque->capacity = new_capacity;
+    }
+
+    deque->items[deque->bottom++ % deque->capacity] = item;
+
+    pthread_mutex_unlock(&deque->mutex);
+}
+
+static bool deque_pop(walk_deque *deque, walk_item *item) {
+    pthread_mutex_lock(&deque->mutex);
+
+    bool found = deque->bottom != deque->top;
+    if (found) {
+        *item = deque->items[--deque->bottom % deque->capacity];
+    }
+
+    pthread_mutex_unlock(&deque->mutex);
+    return found;
+}
+
+static bool deque_steal(walk_deque *deque, walk_item *item) {
+    pthread_mutex_lock(&deque->mutex);
+
+    bool found = deque->bottom != deque->top;
+    if (found) {
+        *item = deque->items[deque->top++ % deque->capacity];
+    }
+
+    pthread_mutex_unlock(&deque->mutex);
+    return found;
+}
+
+static void push_dir(walk_worker *worker, walk_item item) {
+    walk_state *state = worker->state;
+
+    atomic_fetch_add(&state->pending, 1);
+    if (item.dir_fd != -1) {
+        atomic_fetch_add(&state->queued_fds, 1);
+    }
+
+    deque_push(&worker->deque, item);
+    atomic_fetch_add(&state->queued, 1);
+
+    pthread_mutex_lock(&state->idle_mutex);
+    pthread_cond_signal(&state->idle_cond);
+    pthread_mutex_unlock(&state->idle_mutex);
+}
+
+static bool take_dir(walk_worker *worker, walk_item *item) {
+    walk_state *state = worker->state;
+    bool found = deque_pop(&worker->deque, item);
+
+    for (size_t i = 1; !found && i < state->worker_count; i++) {
+        found = deque_steal(&state->workers[(worker->id + i) % state->worker_count].deque, item);
+    }
+
+    if (found) {
+        atomic_fetch_sub(&state->queued, 1);
+        if (item->dir_fd != -1) {
+            atomic_fetch_sub(&state->queued_fds, 1);
+        }
+    }
+
+    return found;
+}
+
+static unsigned char entry_type(int dir_fd, struct dirent64 *entry) {
+    if (entry->d_type != DT_UNKNOWN) {
+        return entry->d_type;
+    }
+
+    //some filesystems don't fill d_type in
+    struct stat st;
+    if (fstatat(dir_fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+        return DT_UNKNOWN;
+    }
+
+    return S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+}
+
+static bool has_suffix(const char *name, size_t name_len, const char *suffix, size_t suffix_len) {
+    return name_len >= suffix_len && memcmp(&name[name_len - suffix_len], suffix, suffix_len) == 0;
+}
+
+static void process_dir(walk_worker *worker, walk_item *item) {
+    walk_state *state = worker->state;
+
+    int dir_fd = item->dir_fd;
+    if (dir_fd == -1) {
+        dir_fd = openat(state->root_fd, item->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dir_fd == -1) {
+            perror(item->path);
+            return;
+        }
+    }
+
+    //names get appended right after the directory prefix, which is written once
+    size_t prefix_len = strlen(item->path);
+    memcpy(worker->path, item->path, prefix_len);
+
+    ssize_t n;
+    while ((n = getdents64(dir_fd, worker->dents, DENTS_SIZE)) > 0) {
+        for (ssize_t off = 0; off < n;) {
+            struct dirent64 *curr_dirent = (struct dirent64 *)&worker->dents[off];
+            off += curr_dirent->d_reclen;
+
+            const char *name = curr_dirent->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+            size_t name_len = strlen(name);
+            if (prefix_len + name_len + 2 > PATH_MAX) {
+                fprintf(stderr, "%s%s: path too long\n", item->path, name);
+                continue;
+            }
+
+            //most names are rejected right here, before any syscall or copy
+            bool wanted = has_suffix(name, name_len, state->suffix, state->suffix_len);
+            if (!wanted && (curr_dirent->d_type == DT_REG || item->depth == 0)) continue;
+
+            unsigned char type = entry_type(dir_fd, curr_dirent);
+
+            if (type == DT_REG && wanted) {
+                memcpy(&worker->path[prefix_len], name, name_len + 1);
+                state->on_file(worker->id, dir_fd, name, worker->path, state->arg);
+            }
+            else if (type == DT_DIR && item->depth > 0) {
+                memcpy(&worker->path[prefix_len], name, name_len);
+                memcpy(&worker->path[prefix_len + name_len], "/", 2);
+
+                walk_item subdir = { .dir_fd = -1, .depth = item->depth - 1, .path = strdup(worker->path) };
+
+                if (atomic_load(&state->queued_fds) < MAX_QUEUED_FDS) {
+                    subdir.dir_fd = openat(dir_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                }
+
+                push_dir(worker, subdir);
+            }
+        }
+    }
+
+    if (n == -1) {
+        perror(item->path[0] ? item->path : ".");
+    }
+
+    close(dir_fd);
+}
+
+static void *worker_loop(void *arg) {
+    walk_worker *worker = arg;
+    walk_state *state = worker->state;
+
+    while (true) {
+        walk_item item;
+
+        if (take_dir(worker, &item)) {
+            process_dir(worker, &item);
+            free(item.path);
+
+            //the last directory out wakes everybody up to finish
+            if (atomic_fetch_sub(&state->pending, 1) == 1) {
+                pthread_mutex_lock(&state->idle_mutex);
+                pthread_cond_broadcast(&state->idle_cond);
+                pthread_mutex_unlock(&state->idle_mutex);
+            }
+
+            continue;
+        }
+
+        pthread_mutex_lock(&state->idle_mutex);
+        while (atomic_load(&state->queued) == 0 && atomic_load(&state->pending) > 0) {
+            pthread_cond_wait(&state->idle_cond, &state->idle_mutex);
+        }
+        bool done = atomic_load(&state->pending) == 0;
+        pthread_mutex_unlock(&state->idle_mutex);
+
+        if (done) {
+            return NULL;
+        }
+    }
+}
+
+bool walk_tree(const char *root, size_t max_depth, size_t worker_count, const char *suffix, walk_file_fn on_file, void *arg) {
+    walk_state state = {
+        .worker_count = worker_count,
+        .suffix = suffix,
+        .suffix_len = strlen(suffix),
+        .on_file = on_file,
+        .arg = arg
+    };
+
+    state.root_fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (state.root_fd == -1) {
+        perror(root);
+        return false;
+    }
+
+    atomic_init(&state.pending, 0);
+    atomic_init(&state.queued, 0);
+    atomic_init(&state.queued_fds, 0);
+    pthread_mutex_init(&state.idle_mutex, NULL);
+    pthread_cond_init(&state.idle_cond, NULL);
+
+    state.workers = calloc(worker_count, sizeof(*state.workers));
+    for (size_t i = 0; i < worker_count; i++) {
+        state.workers[i].id = i;
+        state.workers[i].state = &state;
+        state.workers[i].dents = malloc(DENTS_SIZE);
+        deque_init(&state.workers[i].deque);
+    }
+
+    //the root is walked through its own duplicate, root_fd stays around for reopening by path
+    walk_item root_item = { .dir_fd = dup(state.root_fd), .depth = max_depth, .path = strdup("") };
+    push_dir(&state.workers[0], root_item);
+
+    for (size_t i = 0; i < worker_count; i++) {
+        pthread_create(&state.workers[i].thread, NULL, worker_loop, &state.workers[i]);
+    }
+
+    for (size_t i = 0; i < worker_count; i++) {
+        pthread_join(state.workers[i].thread, NULL);
+        deque_free(&state.workers[i].deque);
+        free(state.workers[i].dents);
+    }
+
+    free(state.workers);
+    pthread_mutex_destroy(&state.idle_mutex);
+    pthread_cond_destroy(&state.idle_cond);
+    close(state.root_fd);
+
+    return true;
+}
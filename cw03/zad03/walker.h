@@ -0,0 +1,13 @@
+#pragma once
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * called for every regular file whose name ends with the walk suffix, dir_fd is the directory
+ * containing it and path its path relative to the walk root
+ * 
+ * path lives in a buffer owned by the calling worker, it's only valid during the call
+ */
+typedef void (*walk_file_fn)(size_t worker_id, int dir_fd, const char *name, const char *path, void *arg);
+
+bool walk_tree(const char *root, size_t max_depth, size_t worker_count, const char *suffix, walk_file_fn on_file, void *arg);
@@ -0,0 +1,292 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define MAX_POINTS 16
+//runs that would take longer than this at their send rate are skipped
+#define MAX_RUN_SECONDS 5.0
+
+typedef struct {
+    const char *name;
+    int data_sig;
+    int end_sig;
+    bool queued; //sigqueue instead of kill
+} sig_mode;
+
+//what the catcher reports back once the end signal arrives
+typedef struct {
+    long received;
+    long handler_ns;
+    long handler_max_ns;
+} catcher_report;
+
+static volatile sig_atomic_t end_received = 0;
+static volatile long received = 0;
+static volatile long handler_ns = 0;
+static volatile long handler_max_ns = 0;
+static long handler_work_ns = 0;
+static int data_sig;
+
+static long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+//handlers run with every test signal blocked, so the counters need no more care than that
+static void catcher_handler(int sig, siginfo_t *info, void *ctx) {
+    long start = now_ns();
+
+    if (sig != data_sig) {
+        end_received = 1;
+        return;
+    }
+
+    received++;
+
+    //simulated work, a slower catcher coalesces (or queues) more
+    while (handler_work_ns > 0 && now_ns() - start < handler_work_ns)
+        ;
+
+    long spent = now_ns() - start;
+    handler_ns += spent;
+    if (spent > handler_max_ns) {
+        handler_max_ns = spent;
+    }
+}
+
+static void run_catcher(const sig_mode *mode, int report_fd) {
+    data_sig = mode->data_sig;
+
+    struct sigaction act;
+    act.sa_sigaction = catcher_handler;
+    act.sa_flags = SA_SIGINFO;
+    sigemptyset(&act.sa_mask);
+    sigaddset(&act.sa_mask, mode->data_sig);
+    sigaddset(&act.sa_mask, mode->end_sig);
+
+    sigaction(mode->data_sig, &act, NULL);
+    sigaction(mode->end_sig, &act, NULL);
+
+    sigset_t unblock;
+    sigfillset(&unblock);
+    sigdelset(&unblock, SIGINT);
+    sigdelset(&unblock, mode->data_sig);
+    sigdelset(&unblock, mode->end_sig);
+
+    //the sender starts only once the handlers are in place
+    char ready = 1;
+    write(report_fd, &ready, 1);
+
+    //the end signal has the higher number, so everything pending before it gets handled first
+    while (!end_received) {
+        sigsuspend(&unblock);
+    }
+
+    catcher_report report = { .received = received, .handler_ns = handler_ns, .handler_max_ns = handler_max_ns };
+    write(report_fd, &report, sizeof(report));
+
+    _exit(EXIT_SUCCESS);
+}
+
+static bool send_signal(const sig_mode *mode, pid_t pid, int sig) {
+    return (mode->queued ? sigqueue(pid, sig, (union sigval){ 0 }) : kill(pid, sig)) == 0;
+}
+
+/**
+ * one point of the sweep: count data signals at rate per second (0 is as fast as possible),
+ * sends refused with EAGAIN are lost, accepted ones that never reached the handler got coalesced
+ */
+static bool run_point(const sig_mode *mode, size_t count, size_t rate) {
+    int fds[2];
+    if (pipe(fds) == -1) {
+        perror("pipe");
+        return false;
+    }
+
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        run_catcher(mode, fds[1]);
+    }
+    close(fds[1]);
+
+    char ready;
+    if (read(fds[0], &ready, 1) != 1) {
+        fprintf(stderr, "catcher died before starting\n");
+        return false;
+    }
+
+    size_t sent = 0;
+    size_t rejected = 0;
+    long start = now_ns();
+
+    for (size_t i = 0; i < count; i++) {
+        if (rate > 0) {
+            long due = start + (long)(i * 1e9 / rate);
+            while (now_ns() < due)
+                ;
+        }
+
+        if (send_signal(mode, pid, mode->data_sig)) {
+            sent++;
+        }
+        else if (errno == EAGAIN) {
+            rejected++;
+        }
+        else {
+            perror(NULL);
+            return false;
+        }
+    }
+
+    double send_time = (now_ns() - start) / 1e9;
+
+    //the end signal may itself hit the queue limit until the catcher drains some
+    while (!send_signal(mode, pid, mode->end_sig)) {
+        if (errno != EAGAIN) {
+            perror(NULL);
+            return false;
+        }
+        sched_yield();
+    }
+
+    catcher_report report;
+    if (read(fds[0], &report, sizeof(report)) != sizeof(report)) {
+        fprintf(stderr, "catcher died before reporting\n");
+        return false;
+    }
+
+    close(fds[0]);
+    waitpid(pid, NULL, 0);
+
+    printf("%s,%zu,%zu,%zu,%zu,%ld,%zu,%.2f,%.0f,%ld,%.6f\n",
+            mode->name, count, rate, sent, rejected, report.received,
+            sent - report.received, 100.0 * report.received / count,
+            report.received ? (double)report.handler_ns / report.received : 0.0,
+            report.handler_max_ns, send_time);
+
+    return true;
+}
+
+static bool parse_list(const char *arg, size_t *values, size_t *count) {
+    char *copy = strdup(arg);
+    char *saveptr;
+    *count = 0;
+
+    for (char *tok = strtok_r(copy, ",", &saveptr); tok; tok = strtok_r(NULL, ",", &saveptr)) {
+        if (*count == MAX_POINTS || sscanf(tok, "%zu", &values[*count]) != 1) {
+            free(copy);
+            return false;
+        }
+        (*count)++;
+    }
+
+    free(copy);
+    return *count > 0;
+}
+
+int main(int argc, char **argv) {
+    const char *counts_arg = "100,1000,10000,100000";
+    const char *rates_arg = "0,1000000,100000,10000";
+    const char *modes_arg = "KILL,SIGQUEUE,SIGRT,SIGRT_QUEUE";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:r:m:w:")) != -1) {
+        switch (opt) {
+            case 'c': counts_arg = optarg; break;
+            case 'r': rates_arg = optarg; break;
+            case 'm': modes_arg = optarg; break;
+            case 'w':
+                if (sscanf(optarg, "%ld", &handler_work_ns) != 1 || handler_work_ns < 0) {
+                    fprintf(stderr, "malformed handler work\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-c counts] [-r rates_per_s] [-m modes] [-w handler_work_ns]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    size_t counts[MAX_POINTS], rates[MAX_POINTS];
+    size_t count_count, rate_count;
+
+    if (!parse_list(counts_arg, counts, &count_count) || !parse_list(rates_arg, rates, &rate_count)) {
+        fprintf(stderr, "malformed count or rate list\n");
+        return EXIT_FAILURE;
+    }
+
+    sig_mode modes[] = {
+        { "KILL", SIGUSR1, SIGUSR2, false },
+        { "SIGQUEUE", SIGUSR1, SIGUSR2, true },
+        { "SIGRT", SIGRTMIN+0, SIGRTMIN+1, false },
+        /**
+         * RT signals are queued one by one whether sent with kill or sigqueue, both charged to
+         * RLIMIT_SIGPENDING of the receiving user, once that's used up sigqueue fails with EAGAIN
+         * while kill still succeeds, the kernel then just marks the signal pending without
+         * a queue entry, so it merges with one already queued
+         */
+        { "SIGRT_QUEUE", SIGRTMIN+0, SIGRTMIN+1, true }
+    };
+    size_t mode_count = sizeof(modes) / sizeof(*modes);
+    bool selected[sizeof(modes) / sizeof(*modes)] = { false };
+
+    char *modes_copy = strdup(modes_arg);
+    char *saveptr;
+    for (char *tok = strtok_r(modes_copy, ",", &saveptr); tok; tok = strtok_r(NULL, ",", &saveptr)) {
+        size_t m = 0;
+        while (m < mode_count && strcmp(tok, modes[m].name) != 0) {
+            m++;
+        }
+
+        if (m == mode_count) {
+            fprintf(stderr, "invalid mode %s\n", tok);
+            free(modes_copy);
+            return EXIT_FAILURE;
+        }
+        selected[m] = true;
+    }
+    free(modes_copy);
+
+    //signals stay pending in the catcher until it sigsuspends, none gets delivered early
+    sigset_t block_all;
+    sigfillset(&block_all);
+    sigdelset(&block_all, SIGINT);
+    sigprocmask(SIG_SETMASK, &block_all, NULL);
+
+    printf("mode,count,rate_per_s,sent,rejected,received,coalesced,delivered_pct,handler_mean_ns,handler_max_ns,send_s\n");
+
+    for (size_t m = 0; m < mode_count; m++) {
+        if (!selected[m]) {
+            continue;
+        }
+
+        for (size_t c = 0; c < count_count; c++) {
+            for (size_t r = 0; r < rate_count; r++) {
+                if (rates[r] > 0 && (double)counts[c] / rates[r] > MAX_RUN_SECONDS) {
+                    continue;
+                }
+
+                if (!run_point(&modes[m], counts[c], rates[r])) {
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,15 @@
+#include "bulk.h"
+
+//splitmix64, so every word differs and reordering shows up in the checksum
+uint64_t bulk_word(size_t idx) {
+    uint64_t z = (idx + 1) * 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+    return z ^ (z >> 31);
+}
+
+//order dependent, unlike a plain sum or xor
+uint64_t bulk_checksum(uint64_t sum, uint64_t word) {
+    return (sum ^ word) * 0x100000001b3ULL;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <signal.h>
+
+/**
+ * bulk transfer over sigqueue: every data signal carries 8 bytes in sival_ptr,
+ * RT signals of one number are queued in order so the stream arrives in order too
+ * 
+ * the first data signal is a header with the ack interval, the catcher acks cumulatively
+ * every that many words, the end signal carries the word count and is answered with the checksum
+ */
+#define BULK_DATA_SIG (SIGRTMIN+2)
+#define BULK_ACK_SIG (SIGRTMIN+3)
+#define BULK_END_SIG (SIGRTMIN+1)
+
+uint64_t bulk_word(size_t idx);
+uint64_t bulk_checksum(uint64_t sum, uint64_t word);
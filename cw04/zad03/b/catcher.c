@@ -1,157 +1,210 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <signal.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "notify.h"
+#include "bulk.h"
+#include "mailbox.h"
+
+//busy polls of the mailbox before falling asleep in futex_wait
+#define DEFAULT_SPINS 1000
+
 #define TYPE_KILL 0
 #define TYPE_SIGQUEUE 1
 #define TYPE_SIGRT 2
 
-volatile sig_atomic_t count_sig1 = 1;
-volatile sig_atomic_t sig1_received = 0;
-volatile sig_atomic_t sig2_received = 0;
-volatile sig_atomic_t sender_type;
-volatile pid_t sender_pid = 0;
+bool send_signal(int sender_type, pid_t pid, int sig, int value);
+int receive_bulk(notifier *n, pid_t sender_pid, size_t ack_every);
+int receive_mailbox(unsigned spins);
 
-void sig_handler(int sig, siginfo_t *info, void *ctx);
+int main(int argc, char **argv) {
+    notify_method method = NOTIFY_HANDLER;
+    //spinning only pays off when the other side runs on another CPU meanwhile
+    unsigned spins = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? DEFAULT_SPINS : 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:s:")) != -1) {
+        if (opt == 's' && sscanf(optarg, "%u", &spins) == 1) {
+            continue;
+        }
+        else if (opt != 'r' || !notify_parse_method(optarg, &method)) {
+            fprintf(stderr, "usage: %s [-r handler|signalfd|sigwait] [-s spins]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
 
-int main() {
     printf("PID: %d\n", getpid());
+    fflush(stdout);
 
     sigset_t block_all;
     sigfillset(&block_all);
     sigdelset(&block_all, SIGINT);
     sigprocmask(SIG_SETMASK, &block_all, NULL);
 
-    sigset_t unblock;
-    sigfillset(&unblock);
-    sigdelset(&unblock, SIGINT);
-    sigdelset(&unblock, SIGUSR1);
-    sigdelset(&unblock, SIGUSR2);
-    sigdelset(&unblock, SIGRTMIN+0);
-    sigdelset(&unblock, SIGRTMIN+1);
-
-    struct sigaction act;
-    act.sa_sigaction = sig_handler;
-    act.sa_flags = SA_SIGINFO;
-    sigemptyset(&act.sa_mask);
-
-    sigaction(SIGUSR1, &act, NULL);
-    sigaction(SIGUSR2, &act, NULL);
-    sigaction(SIGRTMIN+0, &act, NULL);
-    sigaction(SIGRTMIN+1, &act, NULL);
-
-    while (!sig2_received) {
-        sigsuspend(&unblock); //ping
-        
-        switch (sender_type) { //pong
-            case TYPE_KILL: {
-                if (kill(sender_pid, SIGUSR1) == -1) {
-                    perror(NULL);
-                    return EXIT_FAILURE;
-                }
-
-                break;
-            }
-            case TYPE_SIGQUEUE: {
-                if (sigqueue(sender_pid, SIGUSR1, (union sigval){ 0 }) == -1) {
-                    perror(NULL);
-                    return EXIT_FAILURE;
-                }
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    sigaddset(&signals, SIGUSR2);
+    sigaddset(&signals, SIGRTMIN+0);
+    sigaddset(&signals, SIGRTMIN+1);
+    sigaddset(&signals, BULK_DATA_SIG);
+    sigaddset(&signals, MAILBOX_SIG);
+
+    notifier n;
+    if (!notifier_init(&n, method, &signals)) {
+        return EXIT_FAILURE;
+    }
 
-                break;
-            }
-            case TYPE_SIGRT: {
-                if (kill(sender_pid, SIGRTMIN+0) == -1) {
-                    perror(NULL);
-                    return EXIT_FAILURE;
-                }
+    int sender_type = TYPE_KILL;
+    pid_t sender_pid = 0;
+    int sig1_received = 0;
+    notification received;
 
-                break;
-            }
+    while (true) {
+        if (!notifier_wait(&n, &received)) { //ping
+            return EXIT_FAILURE;
         }
-    }
 
-    count_sig1 = 0;
+        //a bulk stream starts with its header
+        if (!sender_pid && received.signo == BULK_DATA_SIG) {
+            int result = receive_bulk(&n, received.pid, (size_t)received.value.sival_ptr);
+            notifier_free(&n);
 
-    switch (sender_type) {
-        case TYPE_KILL: {
-            for (size_t i = 0; i < sig1_received; i++) {
-                if (kill(sender_pid, SIGUSR1) == -1) { //ping
-                    perror(NULL);
-                    return EXIT_FAILURE;
-                }
-                sigsuspend(&unblock); //pong
-            }
+            return result;
+        }
+
+        //no more signals, the sender has set up a mailbox
+        if (!sender_pid && received.signo == MAILBOX_SIG) {
+            notifier_free(&n);
+            return receive_mailbox(spins);
+        }
 
-            if (kill(sender_pid, SIGUSR2) == -1) {
-                perror(NULL);
-                return EXIT_FAILURE;
+        //the first signal tells who the sender is and how it sends
+        if (!sender_pid) {
+            if (received.code == SI_QUEUE) {
+                sender_type = TYPE_SIGQUEUE;
+            }
+            else {
+                sender_type = received.signo == SIGRTMIN+0 || received.signo == SIGRTMIN+1 ? TYPE_SIGRT : TYPE_KILL;
             }
+            sender_pid = received.pid;
+        }
 
-            printf("received %d SIGUSR1 signals\n", sig1_received);
+        if (received.signo == SIGUSR2 || received.signo == SIGRTMIN+1) {
             break;
         }
-        case TYPE_SIGQUEUE: {
-            for (size_t i = 0; i < sig1_received; i++) {
-                if (sigqueue(sender_pid, SIGUSR1, (union sigval){ 0 }) == -1) { //ping
-                    perror(NULL);
-                    return EXIT_FAILURE;
-                }
-                sigsuspend(&unblock); //pong
-            }
 
-            union sigval data = {
-                .sival_int = sig1_received
-            };
+        sig1_received++;
 
-            if (sigqueue(sender_pid, SIGUSR2, data) == -1) {
-                perror(NULL);
-                return EXIT_FAILURE;
-            }
-
-            printf("received %d SIGUSR1 signals\n", sig1_received);
-            break;
+        int pong = sender_type == TYPE_SIGRT ? SIGRTMIN+0 : SIGUSR1;
+        if (!send_signal(sender_type, sender_pid, pong, 0)) { //pong
+            return EXIT_FAILURE;
         }
-        case TYPE_SIGRT: {
-            for (size_t i = 0; i < sig1_received; i++) {
-                if (kill(sender_pid, SIGRTMIN+0) == -1) { //ping
-                    perror(NULL);
-                    return EXIT_FAILURE;
-                }
-                sigsuspend(&unblock); //pong
-            }
+    }
 
-            if (kill(sender_pid, SIGRTMIN+1) == -1) {
-                perror(NULL);
-                return EXIT_FAILURE;
-            }
+    int ping = sender_type == TYPE_SIGRT ? SIGRTMIN+0 : SIGUSR1;
+    int end = sender_type == TYPE_SIGRT ? SIGRTMIN+1 : SIGUSR2;
 
-            printf("received %d SIGRTMIN+0 signals\n", sig1_received);
-            break;
+    for (int i = 0; i < sig1_received; i++) {
+        if (!send_signal(sender_type, sender_pid, ping, 0)) { //ping
+            return EXIT_FAILURE;
         }
+
+        if (!notifier_wait(&n, &received)) { //pong
+            return EXIT_FAILURE;
+        }
+    }
+
+    //sigqueue tells the sender how many got here
+    if (!send_signal(sender_type, sender_pid, end, sig1_received)) {
+        return EXIT_FAILURE;
+    }
+
+    printf("received %d %s signals\n", sig1_received, sender_type == TYPE_SIGRT ? "SIGRTMIN+0" : "SIGUSR1");
+
+    notifier_free(&n);
+}
+
+bool send_signal(int sender_type, pid_t pid, int sig, int value) {
+    int result = sender_type == TYPE_SIGQUEUE
+               ? sigqueue(pid, sig, (union sigval){ .sival_int = value })
+               : kill(pid, sig);
+
+    if (result == -1) {
+        perror(NULL);
+        return false;
     }
+
+    return true;
 }
 
-void sig_handler(int sig, siginfo_t *info, void *ctx) {
-    if (!sender_pid) {
-        if (info->si_code == SI_USER) {
-            sender_type = sig == SIGRTMIN+0 ? TYPE_SIGRT : TYPE_KILL;
+int receive_bulk(notifier *n, pid_t sender_pid, size_t ack_every) {
+    uint64_t checksum = 0;
+    size_t received_words = 0;
+    //the end signal has a lower number, so it overtakes data still pending
+    size_t expected = SIZE_MAX;
+    notification received;
+
+    while (received_words < expected) {
+        if (!notifier_wait(n, &received)) {
+            return EXIT_FAILURE;
         }
-        else if (info->si_code == SI_QUEUE) {
-            sender_type = TYPE_SIGQUEUE;
+
+        if (received.signo == BULK_END_SIG) {
+            expected = (size_t)received.value.sival_ptr;
+            continue;
         }
-        sender_pid = info->si_pid;
-    }
 
-    if (sig == SIGUSR1 || sig == SIGRTMIN+0) {
-        if (count_sig1) {
-            sig1_received++;
+        checksum = bulk_checksum(checksum, (uint64_t)received.value.sival_ptr);
+        received_words++;
+
+        if (received_words % ack_every == 0
+                && sigqueue(sender_pid, BULK_ACK_SIG, (union sigval){ .sival_ptr = (void *)received_words }) == -1) {
+            perror(NULL);
+            return EXIT_FAILURE;
         }
     }
-    else if (sig == SIGUSR2 || sig == SIGRTMIN+1) {
-        sig2_received++;
+
+    if (sigqueue(sender_pid, BULK_END_SIG, (union sigval){ .sival_ptr = (void *)checksum }) == -1) {
+        perror(NULL);
+        return EXIT_FAILURE;
+    }
+
+    printf("received %zu words (%zu bytes)\n", received_words, received_words * sizeof(uint64_t));
+
+    return EXIT_SUCCESS;
+}
+
+int receive_mailbox(unsigned spins) {
+    mailbox *box = mailbox_open(getpid());
+    if (!box) {
+        return EXIT_FAILURE;
+    }
+
+    uint32_t ping_seen = 0;
+    uint32_t received = 0;
+
+    while (true) {
+        ping_seen = mailbox_wait(&box->ping, ping_seen, spins); //ping
+
+        if (atomic_load(&box->done)) {
+            break;
+        }
+
+        received++;
+        mailbox_post(&box->pong); //pong
     }
+
+    atomic_store(&box->received, received);
+    mailbox_post(&box->pong);
+
+    printf("received %u mailbox pings\n", received);
+
+    mailbox_close(box);
+    return EXIT_SUCCESS;
 }
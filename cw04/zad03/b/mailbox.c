@@ -0,0 +1,102 @@
+#include "mailbox.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define NAME_SIZE 64
+
+static void mailbox_name(char *name, pid_t catcher_pid) {
+    snprintf(name, NAME_SIZE, "/cw04_zad03_b.%d", catcher_pid);
+}
+
+static long futex(_Atomic uint32_t *addr, int op, uint32_t val) {
+    //not FUTEX_PRIVATE_FLAG, the word is shared between processes
+    return syscall(SYS_futex, addr, op, val, NULL, NULL, 0);
+}
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static mailbox *mailbox_map(pid_t catcher_pid, int flags) {
+    char name[NAME_SIZE];
+    mailbox_name(name, catcher_pid);
+
+    int fd = shm_open(name, flags, 0600);
+    if (fd == -1) {
+        perror(name);
+        return NULL;
+    }
+
+    if (flags & O_CREAT && ftruncate(fd, sizeof(mailbox)) == -1) {
+        perror(name);
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+
+    mailbox *box = mmap(NULL, sizeof(mailbox), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (box == MAP_FAILED) {
+        perror(name);
+        return NULL;
+    }
+
+    return box;
+}
+
+mailbox *mailbox_create(pid_t catcher_pid) {
+    //a fresh shm object reads as zeros, which is the initial state
+    return mailbox_map(catcher_pid, O_RDWR | O_CREAT | O_EXCL);
+}
+
+mailbox *mailbox_open(pid_t catcher_pid) {
+    mailbox *box = mailbox_map(catcher_pid, O_RDWR);
+
+    if (box) {
+        char name[NAME_SIZE];
+        mailbox_name(name, catcher_pid);
+        shm_unlink(name);
+    }
+
+    return box;
+}
+
+void mailbox_close(mailbox *box) {
+    munmap(box, sizeof(*box));
+}
+
+void mailbox_post(mailbox_slot *slot) {
+    atomic_fetch_add(&slot->seq, 1);
+
+    //seq_cst on both sides: either the waiter sees the new seq or we see it sleeping
+    if (atomic_load(&slot->sleeping)) {
+        futex(&slot->seq, FUTEX_WAKE, 1);
+    }
+}
+
+uint32_t mailbox_wait(mailbox_slot *slot, uint32_t seen, unsigned spins) {
+    uint32_t seq;
+
+    for (unsigned i = 0; i < spins; i++) {
+        if ((seq = atomic_load_explicit(&slot->seq, memory_order_acquire)) != seen) {
+            return seq;
+        }
+        cpu_relax();
+    }
+
+    atomic_store(&slot->sleeping, 1);
+    while ((seq = atomic_load(&slot->seq)) == seen) {
+        //EAGAIN when seq moved on in between, EINTR on a signal, both just recheck
+        futex(&slot->seq, FUTEX_WAIT, seen);
+    }
+    atomic_store(&slot->sleeping, 0);
+
+    return seq;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <signal.h>
+#include <sys/types.h>
+
+//sent once by the side that created the mailbox, so the other one opens it
+#define MAILBOX_SIG (SIGRTMIN+4)
+
+//one direction, seq counts posts, sleeping is set while the reader is in futex_wait
+typedef struct {
+    _Atomic uint32_t seq;
+    _Atomic uint32_t sleeping;
+} mailbox_slot;
+
+/**
+ * a shared page with a slot for each direction, waiting spins a little and then
+ * sleeps with futex, posting only makes the wake syscall when somebody sleeps
+ */
+typedef struct {
+    mailbox_slot ping;
+    mailbox_slot pong;
+    _Atomic uint32_t done;
+    //filled in by the catcher when done
+    _Atomic uint32_t received;
+} mailbox;
+
+//the mailbox is named after the catcher, the creator is the sender
+mailbox *mailbox_create(pid_t catcher_pid);
+//opening unlinks the name, the mapping lives on in both processes
+mailbox *mailbox_open(pid_t catcher_pid);
+void mailbox_close(mailbox *box);
+
+void mailbox_post(mailbox_slot *slot);
+//returns the new seq once it differs from seen
+uint32_t mailbox_wait(mailbox_slot *slot, uint32_t seen, unsigned spins);
@@ -0,0 +1,141 @@
+#include "notify.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+
+static const char *method_names[] = { "handler", "signalfd", "sigwait" };
+
+static notification handler_queue[NOTIFY_QUEUE];
+static volatile sig_atomic_t queue_head = 0;
+static volatile sig_atomic_t queue_tail = 0;
+static volatile sig_atomic_t queue_dropped = 0;
+
+static void queue_handler(int sig, siginfo_t *info, void *ctx) {
+    if (queue_tail - queue_head == NOTIFY_QUEUE) {
+        queue_dropped++;
+        return;
+    }
+
+    notification *n = &handler_queue[queue_tail % NOTIFY_QUEUE];
+    n->signo = sig;
+    n->code = info->si_code;
+    n->pid = info->si_pid;
+    n->value = info->si_value;
+
+    queue_tail++;
+}
+
+bool notify_parse_method(const char *name, notify_method *method) {
+    for (size_t i = 0; i < sizeof(method_names) / sizeof(*method_names); i++) {
+        if (strcmp(name, method_names[i]) == 0) {
+            *method = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const char *notify_method_name(notify_method method) {
+    return method_names[method];
+}
+
+bool notifier_init(notifier *n, notify_method method, const sigset_t *signals) {
+    n->method = method;
+    n->signals = *signals;
+    n->fd = -1;
+
+    switch (method) {
+        case NOTIFY_HANDLER: {
+            struct sigaction act;
+            act.sa_sigaction = queue_handler;
+            act.sa_flags = SA_SIGINFO;
+            //handlers never interrupt each other, the queue needs no more than that
+            act.sa_mask = *signals;
+
+            sigfillset(&n->suspend_mask);
+            sigdelset(&n->suspend_mask, SIGINT);
+
+            for (int sig = 1; sig < NSIG; sig++) {
+                if (sigismember(signals, sig) == 1) {
+                    sigaction(sig, &act, NULL);
+                    sigdelset(&n->suspend_mask, sig);
+                }
+            }
+            break;
+        }
+
+        case NOTIFY_SIGNALFD:
+            n->fd = signalfd(-1, signals, SFD_CLOEXEC);
+            if (n->fd == -1) {
+                perror("signalfd");
+                return false;
+            }
+            break;
+
+        case NOTIFY_SIGWAIT:
+            break;
+    }
+
+    return true;
+}
+
+bool notifier_wait(notifier *n, notification *out) {
+    switch (n->method) {
+        case NOTIFY_HANDLER:
+            //handlers only run inside sigsuspend, so the queue can be read without races
+            while (queue_head == queue_tail) {
+                sigsuspend(&n->suspend_mask);
+            }
+
+            if (queue_dropped) {
+                fprintf(stderr, "handler queue overflowed, %d signals dropped\n", queue_dropped);
+                queue_dropped = 0;
+            }
+
+            *out = handler_queue[queue_head % NOTIFY_QUEUE];
+            queue_head++;
+            break;
+
+        case NOTIFY_SIGNALFD: {
+            struct signalfd_siginfo info;
+            if (read(n->fd, &info, sizeof(info)) != sizeof(info)) {
+                perror("signalfd");
+                return false;
+            }
+
+            out->signo = info.ssi_signo;
+            out->code = info.ssi_code;
+            out->pid = info.ssi_pid;
+            out->value.sival_ptr = (void *)(uintptr_t)info.ssi_ptr;
+            break;
+        }
+
+        case NOTIFY_SIGWAIT: {
+            siginfo_t info;
+            while (sigwaitinfo(&n->signals, &info) == -1) {
+                if (errno != EINTR) {
+                    perror("sigwaitinfo");
+                    return false;
+                }
+            }
+
+            out->signo = info.si_signo;
+            out->code = info.si_code;
+            out->pid = info.si_pid;
+            out->value = info.si_value;
+            break;
+        }
+    }
+
+    return true;
+}
+
+void notifier_free(notifier *n) {
+    if (n->fd != -1) {
+        close(n->fd);
+    }
+}
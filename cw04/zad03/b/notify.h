@@ -0,0 +1,40 @@
+#pragma once
+#include <stddef.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <sys/types.h>
+
+//handler method: signals stacked up during one sigsuspend wait in a queue this long
+#define NOTIFY_QUEUE 16384
+
+typedef enum {
+    NOTIFY_HANDLER,  //sigsuspend, an SA_SIGINFO handler queues what arrived
+    NOTIFY_SIGNALFD, //read from a signalfd, no handler and no signal frame
+    NOTIFY_SIGWAIT   //sigwaitinfo, no handler either
+} notify_method;
+
+//what a received signal carried, the same for every method
+typedef struct {
+    int signo;
+    int code;
+    pid_t pid;
+    union sigval value;
+} notification;
+
+typedef struct {
+    notify_method method;
+    sigset_t signals;
+    //handler method only, everything but signals (and SIGINT) stays blocked in sigsuspend
+    sigset_t suspend_mask;
+    int fd;
+} notifier;
+
+bool notify_parse_method(const char *name, notify_method *method);
+const char *notify_method_name(notify_method method);
+
+/**
+ * signals have to be blocked already, they are only ever taken in notifier_wait
+ */
+bool notifier_init(notifier *n, notify_method method, const sigset_t *signals);
+bool notifier_wait(notifier *n, notification *out);
+void notifier_free(notifier *n);
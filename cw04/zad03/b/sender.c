@@ -1,18 +1,63 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <sys/types.h>
 #include <signal.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
 
-volatile sig_atomic_t count_sig1 = 1;
-volatile sig_atomic_t sig1_received = 0;
-volatile sig_atomic_t sig2_received = 0;
-volatile sig_atomic_t catcher_received;
+#include "notify.h"
+#include "stats.h"
+#include "bulk.h"
+#include "mailbox.h"
 
-void sig_handler(int sig, siginfo_t *info, void *ctx);
+//busy polls of the mailbox before falling asleep in futex_wait
+#define DEFAULT_SPINS 1000
+
+typedef struct {
+    const char *name;
+    int ping_sig;
+    int end_sig;
+    bool queued; //sigqueue instead of kill
+} sig_mode;
+
+bool send_signal(const sig_mode *mode, pid_t pid, int sig, int value);
+int send_bulk(notifier *n, pid_t catcher_pid, size_t word_count, size_t window, bool bench);
+double pipe_baseline(size_t word_count, size_t chunk_words);
+int send_mailbox(pid_t catcher_pid, size_t sig_count, unsigned spins, bool bench);
 
 int main(int argc, char **argv) {
+    notify_method method = NOTIFY_HANDLER;
+    bool bench = false;
+    size_t window = 0;
+    //spinning only pays off when the other side runs on another CPU meanwhile
+    unsigned spins = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? DEFAULT_SPINS : 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "br:w:s:")) != -1) {
+        if (opt == 'b') {
+            bench = true;
+        }
+        else if (opt == 'w' && sscanf(optarg, "%zu", &window) == 1 && window > 0) {
+            continue;
+        }
+        else if (opt == 's' && sscanf(optarg, "%u", &spins) == 1) {
+            continue;
+        }
+        else if (opt != 'r' || !notify_parse_method(optarg, &method)) {
+            fprintf(stderr, "usage: %s [-b] [-r handler|signalfd|sigwait] [-w window] [-s spins] catcher_pid sig_count KILL|SIGQUEUE|SIGRT|BULK|FUTEX\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    //from now on argv[1] is the catcher pid
+    argc -= optind - 1;
+    argv += optind - 1;
+
     if (argc != 4) {
         fprintf(stderr, "invalid argument count\n");
         return EXIT_FAILURE;
@@ -23,14 +68,6 @@ int main(int argc, char **argv) {
     sigdelset(&block_all, SIGINT);
     sigprocmask(SIG_SETMASK, &block_all, NULL);
 
-    sigset_t unblock;
-    sigfillset(&unblock);
-    sigdelset(&unblock, SIGINT);
-    sigdelset(&unblock, SIGUSR1);
-    sigdelset(&unblock, SIGUSR2);
-    sigdelset(&unblock, SIGRTMIN+0);
-    sigdelset(&unblock, SIGRTMIN+1);
-    
     pid_t catcher_pid;
     size_t sig_count;
 
@@ -39,119 +76,353 @@ int main(int argc, char **argv) {
         return EXIT_FAILURE;
     }
 
-    struct sigaction act;
-    act.sa_sigaction = sig_handler;
-    act.sa_flags = SA_SIGINFO;
-    sigemptyset(&act.sa_mask);
+    //sig_count 8 byte words streamed with sigqueue instead of ping-pong
+    if (strcmp(argv[3], "BULK") == 0) {
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, BULK_ACK_SIG);
+        sigaddset(&signals, BULK_END_SIG);
+
+        notifier n;
+        if (!notifier_init(&n, method, &signals)) {
+            return EXIT_FAILURE;
+        }
 
-    if (strcmp(argv[3], "KILL") == 0) {
-        sigaction(SIGUSR1, &act, NULL);
-        sigaction(SIGUSR2, &act, NULL);
+        int result = send_bulk(&n, catcher_pid, sig_count, window, bench);
+        notifier_free(&n);
 
-        for (size_t i = 0; i < sig_count; i++) {
-            if (kill(catcher_pid, SIGUSR1) == -1) { //ping
-                perror(NULL);
-                return EXIT_FAILURE;
-            }
-            sigsuspend(&unblock); //pong
+        return result;
+    }
+
+    //the same ping-pong through a shared mailbox, a signal only starts it
+    if (strcmp(argv[3], "FUTEX") == 0) {
+        return send_mailbox(catcher_pid, sig_count, spins, bench);
+    }
+
+    sig_mode modes[] = {
+        { "KILL", SIGUSR1, SIGUSR2, false },
+        { "SIGQUEUE", SIGUSR1, SIGUSR2, true },
+        { "SIGRT", SIGRTMIN+0, SIGRTMIN+1, false }
+    };
+
+    const sig_mode *mode = NULL;
+    for (size_t i = 0; i < sizeof(modes) / sizeof(*modes); i++) {
+        if (strcmp(argv[3], modes[i].name) == 0) {
+            mode = &modes[i];
         }
+    }
 
-        count_sig1 = 0;
+    if (!mode) {
+        fprintf(stderr, "invalid mode\n");
+        return EXIT_FAILURE;
+    }
 
-        if (kill(catcher_pid, SIGUSR2) == -1) {
-            perror(NULL);
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, mode->ping_sig);
+    sigaddset(&signals, mode->end_sig);
+
+    notifier n;
+    if (!notifier_init(&n, method, &signals)) {
+        return EXIT_FAILURE;
+    }
+
+    //microseconds from sending every ping until its pong got taken
+    double *latencies = bench ? malloc(sig_count * sizeof(*latencies)) : NULL;
+    struct timespec run_start;
+    clock_gettime(CLOCK_MONOTONIC, &run_start);
+
+    size_t sig1_received = 0;
+    notification received;
+
+    for (size_t i = 0; i < sig_count; i++) {
+        struct timespec ping_start;
+        if (bench) {
+            clock_gettime(CLOCK_MONOTONIC, &ping_start);
+        }
+
+        if (!send_signal(mode, catcher_pid, mode->ping_sig, 0)) { //ping
             return EXIT_FAILURE;
         }
 
-        while (!sig2_received) {
-            sigsuspend(&unblock); //ping
-            if (!sig2_received && kill(catcher_pid, SIGUSR1) == -1) { //pong
-                perror(NULL);
-                return EXIT_FAILURE;
-            }
+        if (!notifier_wait(&n, &received)) { //pong
+            return EXIT_FAILURE;
         }
 
-        printf("received %d SIGUSR1 signals of %zu sent\n", sig1_received, sig_count);
-    }
-    else if (strcmp(argv[3], "SIGQUEUE") == 0) {
-        sigaction(SIGUSR1, &act, NULL);
-        sigaction(SIGUSR2, &act, NULL);
+        if (bench) {
+            latencies[i] = elapsed_since(&ping_start) * 1e6;
+        }
 
-        for (size_t i = 0; i < sig_count; i++) {
-            if (sigqueue(catcher_pid, SIGUSR1, (union sigval){ 0 }) == -1) { //ping
-                perror(NULL);
-                return EXIT_FAILURE;
-            }
-            sigsuspend(&unblock); //pong
+        if (received.signo == mode->ping_sig) {
+            sig1_received++;
         }
+    }
 
-        count_sig1 = 0;
+    double run_time = elapsed_since(&run_start);
 
-        if (sigqueue(catcher_pid, SIGUSR2, (union sigval){ 0 }) == -1) {
-            perror(NULL);
+    if (!send_signal(mode, catcher_pid, mode->end_sig, 0)) {
+        return EXIT_FAILURE;
+    }
+
+    //the catcher sends back as many pings as it got
+    int catcher_received = 0;
+    while (true) {
+        if (!notifier_wait(&n, &received)) { //ping
             return EXIT_FAILURE;
         }
 
-        while (!sig2_received) {
-            sigsuspend(&unblock); //ping
-            if (!sig2_received && sigqueue(catcher_pid, SIGUSR1, (union sigval){ 0 }) == -1) { //pong
-                perror(NULL);
-                return EXIT_FAILURE;
+        if (received.signo == mode->end_sig) {
+            if (received.code == SI_QUEUE) {
+                catcher_received = received.value.sival_int;
             }
+            break;
         }
 
+        if (!send_signal(mode, catcher_pid, mode->ping_sig, 0)) { //pong
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (mode->queued) {
         printf(
-            "received %d SIGUSR1 signals of %zu sent; catcher received %d\n",
+            "received %zu SIGUSR1 signals of %zu sent; catcher received %d\n",
             sig1_received,
             sig_count,
             catcher_received
         );
     }
-    else if (strcmp(argv[3], "SIGRT") == 0) {
-        sigaction(SIGRTMIN+0, &act, NULL);
-        sigaction(SIGRTMIN+1, &act, NULL);
+    else {
+        printf("received %zu %s signals of %zu sent\n", sig1_received, mode->ping_sig == SIGUSR1 ? "SIGUSR1" : "SIGRTMIN+0", sig_count);
+    }
+
+    if (bench) {
+        report_latencies(stdout, notify_method_name(method), latencies, sig_count, run_time);
+        free(latencies);
+    }
+
+    notifier_free(&n);
+}
+
+bool send_signal(const sig_mode *mode, pid_t pid, int sig, int value) {
+    int result = mode->queued
+               ? sigqueue(pid, sig, (union sigval){ .sival_int = value })
+               : kill(pid, sig);
+
+    if (result == -1) {
+        perror(NULL);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * keeps up to window data signals outstanding, the catcher's cumulative acks open it again
+ * 
+ * pending signals count against RLIMIT_SIGPENDING of the whole user, so the window is kept
+ * well below it and EAGAIN from sigqueue is treated as the window closing early
+ */
+int send_bulk(notifier *n, pid_t catcher_pid, size_t word_count, size_t window, bool bench) {
+    struct rlimit limit;
+    getrlimit(RLIMIT_SIGPENDING, &limit);
+
+    //a full window has to leave room in the catcher's handler queue for the header and the end signal
+    size_t queue_room = NOTIFY_QUEUE - 2;
+
+    size_t max_window = limit.rlim_cur == RLIM_INFINITY ? queue_room : limit.rlim_cur / 2;
+    if (max_window > queue_room) {
+        max_window = queue_room;
+    }
+    if (window == 0 || window > max_window) {
+        window = max_window;
+    }
+
+    size_t ack_every = window / 2 > 0 ? window / 2 : 1;
+
+    struct timespec run_start;
+    clock_gettime(CLOCK_MONOTONIC, &run_start);
+
+    //the header isn't acked, it just tells the catcher how often to ack
+    if (sigqueue(catcher_pid, BULK_DATA_SIG, (union sigval){ .sival_ptr = (void *)ack_every }) == -1) {
+        perror(NULL);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t checksum = 0;
+    size_t sent = 0;
+    size_t acked = 0;
+    size_t stalls = 0;
+    notification received;
+
+    while (sent < word_count) {
+        while (sent < word_count && sent - acked < window) {
+            uint64_t word = bulk_word(sent);
+
+            if (sigqueue(catcher_pid, BULK_DATA_SIG, (union sigval){ .sival_ptr = (void *)word }) == -1) {
+                if (errno == EAGAIN) {
+                    stalls++;
+                    break;
+                }
 
-        for (size_t i = 0; i < sig_count; i++) {
-            if (kill(catcher_pid, SIGRTMIN+0) == -1) { //ping
                 perror(NULL);
                 return EXIT_FAILURE;
             }
-            sigsuspend(&unblock); //pong
+
+            checksum = bulk_checksum(checksum, word);
+            sent++;
+        }
+
+        if (sent == word_count) {
+            break;
+        }
+
+        //window full, wait for the catcher to catch up
+        if (!notifier_wait(n, &received)) {
+            return EXIT_FAILURE;
         }
 
-        count_sig1 = 0;
+        if (received.signo == BULK_ACK_SIG && (size_t)received.value.sival_ptr > acked) {
+            acked = (size_t)received.value.sival_ptr;
+        }
+    }
 
-        if (kill(catcher_pid, SIGRTMIN+1) == -1) {
+    while (sigqueue(catcher_pid, BULK_END_SIG, (union sigval){ .sival_ptr = (void *)word_count }) == -1) {
+        if (errno != EAGAIN || !notifier_wait(n, &received)) {
             perror(NULL);
             return EXIT_FAILURE;
         }
+    }
 
-        while (!sig2_received) {
-            sigsuspend(&unblock); //ping
-            if (kill(catcher_pid, SIGRTMIN+0) == -1) { //pong
-                perror(NULL);
-                return EXIT_FAILURE;
+    //acks still in flight come before the answer
+    do {
+        if (!notifier_wait(n, &received)) {
+            return EXIT_FAILURE;
+        }
+    } while (received.signo != BULK_END_SIG);
+
+    double run_time = elapsed_since(&run_start);
+    uint64_t catcher_checksum = (uint64_t)received.value.sival_ptr;
+
+    printf("sent %zu words (%zu bytes), window %zu, %zu stalls; checksum %s\n",
+            word_count, word_count * sizeof(uint64_t), window, stalls,
+            catcher_checksum == checksum ? "ok" : "MISMATCH");
+    printf("%-20s %10.2f MB/s %12.0f signals/s\n", "sigqueue",
+            word_count * sizeof(uint64_t) / run_time / 1e6, word_count / run_time);
+
+    if (bench) {
+        double word_pipe = pipe_baseline(word_count, 1);
+        double chunk_pipe = pipe_baseline(word_count, 8192);
+
+        printf("%-20s %10.2f MB/s %12.0f writes/s\n", "pipe, 8 B writes",
+                word_count * sizeof(uint64_t) / word_pipe / 1e6, word_count / word_pipe);
+        printf("%-20s %10.2f MB/s\n", "pipe, 64 KiB writes",
+                word_count * sizeof(uint64_t) / chunk_pipe / 1e6);
+    }
+
+    return catcher_checksum == checksum ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+//seconds to push the same words through a pipe to a child, chunk_words at a time
+double pipe_baseline(size_t word_count, size_t chunk_words) {
+    int fds[2];
+    if (pipe(fds) == -1) {
+        perror("pipe");
+        return 0;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[1]);
+
+        uint64_t buf[8192];
+        ssize_t n;
+        uint64_t checksum = 0;
+
+        while ((n = read(fds[0], buf, sizeof(buf))) > 0) {
+            for (size_t i = 0; i < n / sizeof(*buf); i++) {
+                checksum = bulk_checksum(checksum, buf[i]);
             }
         }
 
-        printf("received %d SIGRTMIN+0 signals of %zu sent\n", sig1_received, sig_count);
+        _exit(checksum == 0);
     }
-    else {
-        fprintf(stderr, "invalid mode\n");
-        return EXIT_FAILURE;
+    close(fds[0]);
+
+    uint64_t *chunk = malloc(chunk_words * sizeof(*chunk));
+
+    for (size_t sent = 0; sent < word_count;) {
+        size_t words = word_count - sent < chunk_words ? word_count - sent : chunk_words;
+
+        for (size_t i = 0; i < words; i++) {
+            chunk[i] = bulk_word(sent + i);
+        }
+
+        if (write(fds[1], chunk, words * sizeof(*chunk)) == -1) {
+            perror("write");
+            break;
+        }
+
+        sent += words;
     }
+
+    free(chunk);
+    close(fds[1]);
+    waitpid(pid, NULL, 0);
+
+    return elapsed_since(&start);
 }
 
-void sig_handler(int sig, siginfo_t *info, void *ctx) {
-    if (sig == SIGUSR1 || sig == SIGRTMIN+0) {
-        if (count_sig1) {
-            sig1_received++;
-        }
+int send_mailbox(pid_t catcher_pid, size_t sig_count, unsigned spins, bool bench) {
+    mailbox *box = mailbox_create(catcher_pid);
+    if (!box) {
+        return EXIT_FAILURE;
+    }
+
+    if (kill(catcher_pid, MAILBOX_SIG) == -1) {
+        perror(NULL);
+        mailbox_close(box);
+        return EXIT_FAILURE;
     }
-    else if (sig == SIGUSR2 || sig == SIGRTMIN+1) {
-        sig2_received++;
-        if (info->si_code == SI_QUEUE) {
-            catcher_received = info->si_value.sival_int;
+
+    double *latencies = bench ? malloc(sig_count * sizeof(*latencies)) : NULL;
+    struct timespec run_start;
+    clock_gettime(CLOCK_MONOTONIC, &run_start);
+
+    uint32_t pong_seen = 0;
+    size_t pongs = 0;
+
+    for (size_t i = 0; i < sig_count; i++) {
+        struct timespec ping_start;
+        if (bench) {
+            clock_gettime(CLOCK_MONOTONIC, &ping_start);
         }
+
+        mailbox_post(&box->ping); //ping
+        pong_seen = mailbox_wait(&box->pong, pong_seen, spins); //pong
+
+        if (bench) {
+            latencies[i] = elapsed_since(&ping_start) * 1e6;
+        }
+        pongs++;
+    }
+
+    double run_time = elapsed_since(&run_start);
+
+    //the last ping only says we're done, its pong carries the catcher's count
+    atomic_store(&box->done, 1);
+    mailbox_post(&box->ping);
+    mailbox_wait(&box->pong, pong_seen, spins);
+
+    printf("received %zu mailbox pongs of %zu sent; catcher received %u\n", pongs, sig_count, atomic_load(&box->received));
+
+    if (bench) {
+        report_latencies(stdout, "futex", latencies, sig_count, run_time);
+        free(latencies);
     }
+
+    mailbox_close(box);
+    return EXIT_SUCCESS;
 }
@@ -0,0 +1,42 @@
+#include "stats.h"
+#include <stdlib.h>
+
+double elapsed_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double lhs = *(const double *)a;
+    double rhs = *(const double *)b;
+
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+static double percentile(const double *sorted, size_t n, double p) {
+    //nearest rank
+    size_t rank = (size_t)(p * n);
+    if (rank < p * n) {
+        rank++;
+    }
+
+    return sorted[rank == 0 ? 0 : rank - 1];
+}
+
+void report_latencies(FILE *out, const char *label, double *latencies, size_t count, double elapsed) {
+    if (count == 0) {
+        return;
+    }
+
+    qsort(latencies, count, sizeof(*latencies), compare_doubles);
+
+    //every round trip is two notifications
+    fprintf(out, "%zu round trips in %.3f s: %.0f round trips/s, %.0f notifications/s\n",
+            count, elapsed, count / elapsed, 2 * count / elapsed);
+    fprintf(out, "%-12s %10s %10s %10s %10s\n", "[us]", "p50", "p99", "p999", "max");
+    fprintf(out, "%-12s %10.2f %10.2f %10.2f %10.2f\n", label,
+            percentile(latencies, count, 0.5), percentile(latencies, count, 0.99),
+            percentile(latencies, count, 0.999), latencies[count - 1]);
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+
+double elapsed_since(const struct timespec *start);
+
+/**
+ * sorts latencies (in microseconds) in place and prints the percentile table,
+ * elapsed is the wall time of the whole run in seconds
+ */
+void report_latencies(FILE *out, const char *label, double *latencies, size_t count, double elapsed);
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define MAX_POINTS 16
+
+typedef struct {
+    const char *variant;
+    const char *binary;
+} bench_case;
+
+static const bench_case cases[] = {
+    { "posix_spawnp", "./main" },
+    { "fork", "./main_fork" }
+};
+
+static double elapsed_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/**
+ * one chain of stages cat's behind an echo, the padding definitions are never used,
+ * they only make the interpreter (and so every fork of it) bigger
+ */
+static bool write_script(const char *path, size_t stages, size_t padding) {
+    FILE *script = fopen(path, "w");
+    if (!script) {
+        perror(path);
+        return false;
+    }
+
+    for (size_t i = 0; i < padding; i++) {
+        fprintf(script, "pad%zu = true --padding-argument-%zu\n", i, i);
+    }
+    fprintf(script, "src = echo chained\nc = cat\n\nsrc");
+    for (size_t i = 0; i < stages; i++) {
+        fprintf(script, " | c");
+    }
+    fprintf(script, "\n");
+
+    fclose(script);
+    return true;
+}
+
+//seconds the interpreter takes to get through the script, -1 if it failed
+static double run_once(const char *binary, const char *script) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_RDWR);
+        dup2(null_fd, STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+
+        execl(binary, binary, script, NULL);
+        perror(binary);
+        _exit(EXIT_FAILURE);
+    }
+
+    int wstatus;
+    if (pid == -1 || waitpid(pid, &wstatus, 0) == -1 || !WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) {
+        return -1;
+    }
+
+    return elapsed_since(&start);
+}
+
+static bool parse_list(const char *arg, size_t *values, size_t *count) {
+    char *copy = strdup(arg);
+    char *saveptr;
+    *count = 0;
+
+    for (char *tok = strtok_r(copy, ",", &saveptr); tok; tok = strtok_r(NULL, ",", &saveptr)) {
+        if (*count == MAX_POINTS || sscanf(tok, "%zu", &values[*count]) != 1) {
+            free(copy);
+            return false;
+        }
+        (*count)++;
+    }
+
+    free(copy);
+    return *count > 0;
+}
+
+int main(int argc, char **argv) {
+    const char *stages_arg = "10,100,1000";
+    const char *padding_arg = "0,100000";
+    size_t repeats = 5;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:d:r:")) != -1) {
+        switch (opt) {
+            case 'n': stages_arg = optarg; break;
+            case 'd': padding_arg = optarg; break;
+            case 'r':
+                if (sscanf(optarg, "%zu", &repeats) != 1 || repeats == 0) {
+                    fprintf(stderr, "malformed repeat count\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n stage_counts] [-d padding_definition_counts] [-r repeats]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    size_t stages[MAX_POINTS], paddings[MAX_POINTS];
+    size_t stage_count, padding_count;
+
+    if (!parse_list(stages_arg, stages, &stage_count) || !parse_list(padding_arg, paddings, &padding_count)) {
+        fprintf(stderr, "malformed stage or padding list\n");
+        return EXIT_FAILURE;
+    }
+
+    char script[] = "/tmp/cw05_zad01_bench_XXXXXX";
+    int script_fd = mkstemp(script);
+    if (script_fd == -1) {
+        perror("mkstemp");
+        return EXIT_FAILURE;
+    }
+    close(script_fd);
+
+    printf("variant,stages,definitions,runs,mean_ms,best_ms,per_stage_us\n");
+
+    for (size_t s = 0; s < stage_count; s++) {
+        for (size_t p = 0; p < padding_count; p++) {
+            if (!write_script(script, stages[s], paddings[p])) {
+                unlink(script);
+                return EXIT_FAILURE;
+            }
+
+            for (size_t c = 0; c < sizeof(cases) / sizeof(*cases); c++) {
+                double total = 0;
+                double best = -1;
+
+                for (size_t r = 0; r < repeats; r++) {
+                    double t = run_once(cases[c].binary, script);
+                    if (t < 0) {
+                        fprintf(stderr, "%s failed on %zu stages\n", cases[c].binary, stages[s]);
+                        unlink(script);
+                        return EXIT_FAILURE;
+                    }
+
+                    total += t;
+                    if (best < 0 || t < best) {
+                        best = t;
+                    }
+                }
+
+                printf("%s,%zu,%zu,%zu,%.3f,%.3f,%.2f\n",
+                        cases[c].variant, stages[s], paddings[p] + 2, repeats,
+                        total / repeats * 1e3, best * 1e3, best / stages[s] * 1e6);
+                fflush(stdout);
+            }
+        }
+    }
+
+    unlink(script);
+}
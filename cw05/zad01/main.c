@@ -1,3 +1,5 @@
+#define _GNU_SOURCE //enable pipe2, F_SETPIPE_SZ, splice and tee
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -7,18 +9,31 @@
 #include <sys/wait.h>
 #include <unistd.h>
 #include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <spawn.h>
 
 #include "ptr_vector.h"
+#include "symtab.h"
+#include "profile.h"
 
 #define IN 0
 #define OUT 1
 
+//bytes moved per tee/splice call of a fan-out, the pipes cap it anyway
+#define FAN_OUT_CHUNK (1024 * 1024)
+
+//how often the profiler reads how much every stage has written
+#define PROFILE_INTERVAL_MS 50
+
 //vector of char*
 typedef ptr_vector v_char;
 //vector of vector of char*
 typedef ptr_vector v_v_char;
 //vector of named_pipe
 typedef ptr_vector v_np;
+//vector of exec_line
+typedef ptr_vector v_line;
 
 typedef struct {
     char *name;
@@ -28,23 +43,92 @@ typedef struct {
      * second dim is suitable to pass to exec (i.e first element is the command and the array is NULL-terminated)
      */
     v_v_char exec_args;
+    //fan-out check: 0 not visited, 1 on the current path, 2 fine
+    int fan_out_state;
 } named_pipe;
 
+//an execution line compiled once, every line with the same text shares it
+typedef struct {
+    //shallow copies of the definitions' commands, in pipeline order
+    v_v_char stages;
+} compiled_line;
+
+//one execution line, parsed up front and launched when a job slot frees up
+typedef struct {
+    ssize_t line_no;
+    //owned by the plan cache
+    v_v_char *stages;
+    //every process of the line including fan-outs and their branches, -1 once reaped
+    pid_t *pids;
+    //parallel to pids, owned by the profiler, NULL when not profiling
+    stage_profile **profiles;
+    size_t pid_count;
+    size_t pid_capacity;
+    //processes not reaped yet
+    size_t running;
+} exec_line;
+
 const char *COMMAND_DELIM = "|";
 const char *ARG_DELIM = " \f\n\r\t\v"; //see man isspace
+//a command "^ a b" copies its input into both definitions a and b, it has to end its chain
+const char *FAN_OUT = "^";
+
+//0 keeps the default capacity, otherwise every pipe is resized to it with F_SETPIPE_SZ
+size_t pipe_size = 0;
 
-int named_pipe_ptr_cmp(const void *p1, const void *p2) {
-    named_pipe * const *c1 = p1;
-    named_pipe * const *c2 = p2;
+//set with -s, every stage is then accounted for and a table printed at the end
+profiler *stage_profiler = NULL;
 
-    return strcmp((*c1)->name, (*c2)->name);
+named_pipe *find_pipe(symtab *symbols, const char *name) {
+    return symtab_get(symbols, name);
 }
 
-int named_pipe_search_cmp(const void *key, const void *arr_el) {
-    char * const *key_str = key;
-    named_pipe * const *pipe = arr_el;
+bool is_fan_out(v_char *args) {
+    return strcmp(args->storage[0], FAN_OUT) == 0;
+}
+
+/**
+ * fan-outs name exactly two existing definitions and end their chain,
+ * and following them never loops back
+ */
+bool check_fan_outs(symtab *symbols, named_pipe *pipe) {
+    if (pipe->fan_out_state == 2) {
+        return true;
+    }
+    if (pipe->fan_out_state == 1) {
+        fprintf(stderr, "definition %s: fan-outs loop back into it\n", pipe->name);
+        return false;
+    }
+    pipe->fan_out_state = 1;
+
+    for (size_t i = 0; i < pipe->exec_args.size; i++) {
+        v_char *args = pipe->exec_args.storage[i];
+        if (!is_fan_out(args)) {
+            continue;
+        }
 
-    return strcmp(*key_str, (*pipe)->name);
+        //two names and the NULL terminator
+        if (args->size != 4 || i != pipe->exec_args.size - 1) {
+            fprintf(stderr, "definition %s: a fan-out takes two definitions and ends the chain\n", pipe->name);
+            return false;
+        }
+
+        for (size_t j = 1; j <= 2; j++) {
+            named_pipe *branch = find_pipe(symbols, args->storage[j]);
+
+            if (!branch) {
+                fprintf(stderr, "definition %s: named pipe %s not found\n", pipe->name, (char *)args->storage[j]);
+                return false;
+            }
+
+            if (!check_fan_outs(symbols, branch)) {
+                return false;
+            }
+        }
+    }
+
+    pipe->fan_out_state = 2;
+    return true;
 }
 
 void free_v_char_content(v_char *v) {
@@ -71,6 +155,34 @@ void free_pipes(v_np *pipes) {
     }
 }
 
+void free_lines(v_line *lines) {
+    while (lines->size > 0) {
+        exec_line *line = vec_pop_back(lines);
+
+        free(line->pids);
+        free(line->profiles);
+        free(line);
+    }
+}
+
+void free_plans(symtab *plans) {
+    for (size_t i = 0; i < plans->capacity; i++) {
+        if (plans->entries[i].key) {
+            compiled_line *plan = plans->entries[i].value;
+
+            vec_clear(&plan->stages);
+            free(plan);
+            free((char *)plans->entries[i].key);
+        }
+    }
+
+    symtab_free(plans);
+}
+
+compiled_line *compile_line(symtab *symbols, char *line, ssize_t line_no);
+void launch_line(symtab *symbols, exec_line *line);
+bool run_lines(symtab *symbols, v_line *lines, size_t jobs);
+
 void term_handler(int sig) {
     kill(0, SIGTERM);
     _exit(EXIT_FAILURE);
@@ -78,6 +190,26 @@ void term_handler(int sig) {
 
 int main(int argc, char **argv) {
     int result = EXIT_FAILURE;
+    size_t jobs = 1;
+    bool profile = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "j:p:s")) != -1) {
+        if (opt == 'p' && sscanf(optarg, "%zu", &pipe_size) == 1) {
+            continue;
+        }
+        else if (opt == 's') {
+            profile = true;
+        }
+        else if (opt != 'j' || sscanf(optarg, "%zu", &jobs) != 1 || jobs < 1) {
+            fprintf(stderr, "usage: %s [-j jobs] [-p pipe_size] [-s] script\n", argv[0]);
+            return result;
+        }
+    }
+
+    //from now on argv[1] is the script
+    argc -= optind - 1;
+    argv += optind - 1;
 
     if (argc != 2) {
         fprintf(stderr, "invalid argument count\n");
@@ -101,8 +233,19 @@ int main(int argc, char **argv) {
     
     sigaction(SIGTERM, &act, NULL);
 
+    //owns the definitions, symbols is what they're looked up in
     v_np pipes;
     vec_init(&pipes);
+    symtab symbols;
+    symtab_init(&symbols);
+
+    //execution line text -> compiled_line, repeated lines are parsed and looked up once
+    symtab plans;
+    symtab_init(&plans);
+
+    //execution lines share nothing but the (read only) definitions, so any of them may run side by side
+    v_line lines;
+    vec_init(&lines);
 
     bool definitions = true;
 
@@ -116,8 +259,12 @@ int main(int argc, char **argv) {
         if (line[0] == '\n') {
             if (definitions) {
                 definitions = false;
-                //sort our dictionary so we can bsearch in it
-                qsort(pipes.storage, pipes.size, sizeof(*pipes.storage), named_pipe_ptr_cmp);
+
+                for (size_t i = 0; i < pipes.size; i++) {
+                    if (!check_fan_outs(&symbols, pipes.storage[i])) {
+                        goto cleanup;
+                    }
+                }
             }
             continue;
         }
@@ -129,6 +276,7 @@ int main(int argc, char **argv) {
             if (before_eq) {
                 named_pipe *pipe = malloc(sizeof(*pipe));
                 pipe->name = NULL;
+                pipe->fan_out_state = 0;
                 vec_init(&pipe->exec_args);
                 vec_push_back(&pipes, pipe);
 
@@ -139,6 +287,8 @@ int main(int argc, char **argv) {
                     goto cleanup;
                 }
                 pipe->name = strdup(stripped_name);
+                //a later definition of the same name wins
+                symtab_put(&symbols, pipe->name, pipe);
 
                 //watch out for strtok reentrant calls
                 char *command_saveptr = NULL;
@@ -179,111 +329,519 @@ int main(int argc, char **argv) {
             }
         }
         else {
-            v_v_char exec_args_shallow; //we'll concat command lists, by shallow copy of ptrs to args lists
-            vec_init(&exec_args_shallow);
+            compiled_line *plan = symtab_get(&plans, line);
 
-            char *name_saveptr = NULL;
-            char *name = strtok_r(line, COMMAND_DELIM, &name_saveptr);
+            if (!plan) {
+                //compiling cuts the line up, the key is taken before that
+                char *key = strdup(line);
 
-            if (!name) {
-                fprintf(stderr, "line %zd: empty named pipe chain\n", line_no);
+                plan = compile_line(&symbols, line, line_no);
+                if (!plan) {
+                    free(key);
+                    goto cleanup;
+                }
 
-                goto cleanup;
+                symtab_put(&plans, key, plan);
             }
 
-            while (name) {
-                char *stripped_name_saveptr = NULL;
-                char *stripped_name = strtok_r(name, ARG_DELIM, &stripped_name_saveptr);
+            exec_line *exec = malloc(sizeof(*exec));
+            exec->line_no = line_no;
+            exec->stages = &plan->stages;
+            exec->pids = NULL;
+            exec->profiles = NULL;
+            exec->pid_count = 0;
+            exec->pid_capacity = 0;
+            exec->running = 0;
+            vec_push_back(&lines, exec);
+        }
+    }
 
-                if (!stripped_name) {
-                    fprintf(stderr, "line %zd: empty named pipe in chain\n", line_no);
+    profiler prof;
+    if (profile) {
+        profiler_start(&prof, PROFILE_INTERVAL_MS);
+        stage_profiler = &prof;
+    }
 
-                    vec_clear(&exec_args_shallow);
-                    goto cleanup;
-                }
+    bool ran = run_lines(&symbols, &lines, jobs);
+
+    if (stage_profiler) {
+        profiler_stop(stage_profiler);
+        profiler_report(stage_profiler, stderr);
+        profiler_free(stage_profiler);
+        stage_profiler = NULL;
+    }
 
-                named_pipe **pipe_ptr = bsearch(
-                    &stripped_name,
-                    pipes.storage,
-                    pipes.size,
-                    sizeof(*pipes.storage),
-                    named_pipe_search_cmp
-                );
+    if (!ran) {
+        goto cleanup;
+    }
 
-                if (!pipe_ptr) {
-                    fprintf(stderr, "line %zd: named pipe not found\n", line_no);
+    result = EXIT_SUCCESS;
 
-                    vec_clear(&exec_args_shallow);
-                    goto cleanup;
-                }
+    cleanup:
+    free(line);
+    free_lines(&lines);
+    free_plans(&plans);
+    symtab_free(&symbols);
+    free_pipes(&pipes);
+    fclose(input);
 
-                named_pipe *pipe = *pipe_ptr;
-                for (size_t i = 0; i < pipe->exec_args.size; i++) {
-                    vec_push_back(&exec_args_shallow, pipe->exec_args.storage[i]);
-                }
+    return result;
+}
+
+compiled_line *compile_line(symtab *symbols, char *line, ssize_t line_no) {
+    compiled_line *plan = malloc(sizeof(*plan));
+    vec_init(&plan->stages); //we'll concat command lists, by shallow copy of ptrs to args lists
+
+    char *name_saveptr = NULL;
+    char *name = strtok_r(line, COMMAND_DELIM, &name_saveptr);
+
+    if (!name) {
+        fprintf(stderr, "line %zd: empty named pipe chain\n", line_no);
+
+        goto error;
+    }
+
+    while (name) {
+        char *stripped_name_saveptr = NULL;
+        char *stripped_name = strtok_r(name, ARG_DELIM, &stripped_name_saveptr);
+
+        if (!stripped_name) {
+            fprintf(stderr, "line %zd: empty named pipe in chain\n", line_no);
+
+            goto error;
+        }
+
+        named_pipe *pipe = find_pipe(symbols, stripped_name);
+
+        if (!pipe) {
+            fprintf(stderr, "line %zd: named pipe not found\n", line_no);
+
+            goto error;
+        }
+
+        //a fan-out has no stdout left for whatever would follow it
+        if (plan->stages.size > 0 && is_fan_out(plan->stages.storage[plan->stages.size - 1])) {
+            fprintf(stderr, "line %zd: fan-out has to end the chain\n", line_no);
+
+            goto error;
+        }
+
+        for (size_t i = 0; i < pipe->exec_args.size; i++) {
+            vec_push_back(&plan->stages, pipe->exec_args.storage[i]);
+        }
+
+        name = strtok_r(NULL, COMMAND_DELIM, &name_saveptr);
+    }
+
+    return plan;
+
+    error:
+    vec_clear(&plan->stages);
+    free(plan);
+
+    return NULL;
+}
+
+bool make_pipe(int fd[2]) {
+    //close-on-exec, so stages of other lines started meanwhile never hold our ends
+    if (pipe2(fd, O_CLOEXEC) == -1) {
+        perror("pipe");
+        return false;
+    }
+
+    //the kernel rounds it up to pages, fails above /proc/sys/fs/pipe-max-size for the unprivileged
+    if (pipe_size > 0 && fcntl(fd[OUT], F_SETPIPE_SZ, (int)pipe_size) == -1) {
+        perror("F_SETPIPE_SZ");
+    }
+
+    return true;
+}
+
+void add_pid(exec_line *line, pid_t pid, const char *command) {
+    if (line->pid_count == line->pid_capacity) {
+        line->pid_capacity = line->pid_capacity == 0 ? 8 : 2 * line->pid_capacity;
+        line->pids = reallocarray(line->pids, line->pid_capacity, sizeof(*line->pids));
+        line->profiles = reallocarray(line->profiles, line->pid_capacity, sizeof(*line->profiles));
+    }
 
-                name = strtok_r(NULL, COMMAND_DELIM, &name_saveptr);
+    line->profiles[line->pid_count] = stage_profiler
+                                    ? profiler_add(stage_profiler, line->line_no, line->pid_count, command, pid)
+                                    : NULL;
+    line->pids[line->pid_count++] = pid;
+    line->running++;
+}
+
+/**
+ * a branch that exits early (think head) only stops being fed, the other one still gets
+ * the whole input, the fan-out ends once its input does or both branches are gone
+ */
+bool branch_gone(int *out) {
+    if (errno != EPIPE) {
+        return false;
+    }
+
+    close(*out);
+    *out = -1;
+    return true;
+}
+
+//plain copy for when the input isn't a pipe, tee needs pipes on both sides
+int copy_fan_out(int in, int outs[2]) {
+    char buf[64 * 1024];
+    ssize_t n;
+
+    while ((outs[0] != -1 || outs[1] != -1) && (n = read(in, buf, sizeof(buf))) > 0) {
+        for (size_t i = 0; i < 2; i++) {
+            if (outs[i] != -1 && write(outs[i], buf, n) != n && !branch_gone(&outs[i])) {
+                perror("fan-out");
+                return EXIT_FAILURE;
             }
+        }
+    }
 
-            /**
-             * merging schema (elements in parentheses are dup2'd):
-             * 
-             *  (STDOUT_of_proc_A -> fd[OUT]) -> (fd[IN] -> STDIN_of_proc_B)
-             *             ^^^^^^                          ^^^^^^
-             *              dup2                            dup2
-             * we shall iterate in backward order, to prevent pipe buffers
-             * (16 pages * 4kB/page) from clogging
-             */
-            int stdout_to_inject;
-            for (ssize_t i = exec_args_shallow.size - 1; i >= 0; i--) {
-                v_char *args_vec = exec_args_shallow.storage[i];
-                char **args = (char**)args_vec->storage;
-
-                int fd[2];
-                if (i > 0) {
-                    pipe(fd);
-                }
+    return n >= 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 
-                if (fork() == 0) {
-                    if (i < exec_args_shallow.size - 1) {
-                        dup2(stdout_to_inject, STDOUT_FILENO);
-                    }
-                    if (i > 0) {
-                        close(fd[OUT]);
-                        dup2(fd[IN], STDIN_FILENO);
-                    }
-                    execvp(args[0], args);
-                    goto cleanup; //in case it fails
-                }
+//drops n bytes already passed on to the branch left, the one they were meant for is gone
+bool skip_input(int in, size_t n) {
+    char buf[64 * 1024];
 
-                if (i < exec_args_shallow.size - 1) {
-                    close(stdout_to_inject);
-                }
-                if (i > 0) {
-                    close(fd[IN]);
-                    stdout_to_inject = fd[OUT];
-                }
+    while (n > 0) {
+        ssize_t skipped = read(in, buf, n < sizeof(buf) ? n : sizeof(buf));
+        if (skipped <= 0) {
+            return false;
+        }
+        n -= skipped;
+    }
+
+    return true;
+}
+
+//what's left once a branch is gone, a splice straight into the other one
+int single_fan_out(int in, int out) {
+    while (true) {
+        ssize_t moved = splice(in, NULL, out, NULL, FAN_OUT_CHUNK, SPLICE_F_MOVE);
+
+        if (moved == 0 || (moved == -1 && branch_gone(&out))) {
+            return EXIT_SUCCESS;
+        }
+        if (moved == -1) {
+            perror("splice");
+            return EXIT_FAILURE;
+        }
+    }
+}
+
+/**
+ * tee duplicates what's in the input pipe into the first branch without consuming it,
+ * then splice moves the very same bytes into the second one, nothing passes through user space
+ */
+int fan_out(int in, int out1, int out2) {
+    //a branch reading no more shows up as EPIPE rather than killing us
+    signal(SIGPIPE, SIG_IGN);
+
+    int outs[2] = { out1, out2 };
+
+    while (true) {
+        ssize_t n = tee(in, outs[0], FAN_OUT_CHUNK, 0);
+
+        if (n == 0) {
+            return EXIT_SUCCESS;
+        }
+        if (n == -1) {
+            if (errno == EINVAL) {
+                return copy_fan_out(in, outs);
+            }
+            if (branch_gone(&outs[0])) {
+                return single_fan_out(in, outs[1]);
             }
 
-            int wstatus;
-            while (wait(&wstatus) > 0) {
-                int exit_status;
-                if (WIFEXITED(wstatus) && (exit_status = WEXITSTATUS(wstatus)) != 0) {
-                    fprintf(stderr, "MISSION ABORT, SOME PROCESS RETURNED NONZERO CODE: %d\n", exit_status);
-                    raise(SIGTERM);
-                }
+            perror("tee");
+            return EXIT_FAILURE;
+        }
+
+        while (n > 0) {
+            ssize_t moved = splice(in, NULL, outs[1], NULL, n, SPLICE_F_MOVE);
+            if (moved == -1 && branch_gone(&outs[1])) {
+                return skip_input(in, n) ? single_fan_out(in, outs[0]) : EXIT_FAILURE;
+            }
+            if (moved <= 0) {
+                perror("splice");
+                return EXIT_FAILURE;
+            }
+            n -= moved;
+        }
+    }
+}
+
+#ifndef FORK_STAGES
+extern char **environ;
+
+/**
+ * posix_spawnp copies no page tables (glibc clones with CLONE_VM | CLONE_VFORK),
+ * which matters once the parsed script makes us big
+ * 
+ * only the dup2s are file actions, every other pipe end we hold is close-on-exec
+ */
+pid_t spawn_stage(char **args, int in_fd, int out_fd) {
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+
+    if (out_fd != -1) {
+        posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+    }
+    if (in_fd != -1) {
+        posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO);
+    }
+
+    pid_t pid;
+    int err = posix_spawnp(&pid, args[0], &actions, NULL, args, environ);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (err != 0) {
+        //the same as the stage failing right away
+        fprintf(stderr, "%s: %s\n", args[0], strerror(err));
+        raise(SIGTERM);
+    }
+
+    return pid;
+}
+#else
+pid_t spawn_stage(char **args, int in_fd, int out_fd) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (out_fd != -1) {
+            dup2(out_fd, STDOUT_FILENO);
+        }
+        if (in_fd != -1) {
+            dup2(in_fd, STDIN_FILENO);
+        }
+        execvp(args[0], args);
+
+        perror(args[0]);
+        _exit(EXIT_FAILURE);
+    }
+
+    if (pid == -1) {
+        perror("fork");
+    }
+
+    return pid;
+}
+#endif
+
+//closes every descriptor but stdio and the three given
+void keep_fds(int a, int b, int c) {
+    int keep[] = { a, b, c };
+
+    //sorted, so the ranges in between can go with close_range
+    for (size_t i = 0; i < 3; i++) {
+        for (size_t j = i + 1; j < 3; j++) {
+            if (keep[j] < keep[i]) {
+                int tmp = keep[i];
+                keep[i] = keep[j];
+                keep[j] = tmp;
             }
+        }
+    }
 
-            vec_clear(&exec_args_shallow);
+    unsigned first = STDERR_FILENO + 1;
+    for (size_t i = 0; i < 3; i++) {
+        if (keep[i] >= (int)first) {
+            if (keep[i] > (int)first) {
+                close_range(first, keep[i] - 1, 0);
+            }
+            first = keep[i] + 1;
         }
     }
+    close_range(first, ~0U, 0);
+}
 
-    result = EXIT_SUCCESS;
+/**
+ * merging schema (elements in parentheses are dup2'd):
+ * 
+ *  (STDOUT_of_proc_A -> fd[OUT]) -> (fd[IN] -> STDIN_of_proc_B)
+ *             ^^^^^^                          ^^^^^^
+ *              dup2                            dup2
+ * 
+ * in_fd is the read end feeding the first stage, -1 for our own stdin,
+ * a fan-out at the end starts both its branches the same way
+ */
+void launch_chain(symtab *symbols, exec_line *line, v_v_char *stages, int in_fd) {
+    for (size_t i = 0; i < stages->size; i++) {
+        v_char *args_vec = stages->storage[i];
+        char **args = (char**)args_vec->storage;
+
+        if (is_fan_out(args_vec)) {
+            int branch_fds[2][2];
+            if (!make_pipe(branch_fds[0])) {
+                break;
+            }
+            if (!make_pipe(branch_fds[1])) {
+                close(branch_fds[0][IN]);
+                close(branch_fds[0][OUT]);
+                break;
+            }
 
-    cleanup:
-    free(line);
-    free_pipes(&pipes);
-    fclose(input);
+            pid_t pid = fork();
+            if (pid == 0) {
+                int in = in_fd == -1 ? STDIN_FILENO : in_fd;
 
-    return result;
+                //never exec'd, so close-on-exec doesn't help, the branches' read ends and
+                //every pipe of the other lines would stay open and a branch could never see EPIPE
+                keep_fds(in, branch_fds[0][OUT], branch_fds[1][OUT]);
+                _exit(fan_out(in, branch_fds[0][OUT], branch_fds[1][OUT]));
+            }
+
+            if (pid != -1) {
+                add_pid(line, pid, FAN_OUT);
+            }
+            else {
+                perror("fork");
+            }
+
+            if (in_fd != -1) {
+                close(in_fd);
+            }
+            close(branch_fds[0][OUT]);
+            close(branch_fds[1][OUT]);
+
+            //checked when the definitions were read, both exist
+            launch_chain(symbols, line, &find_pipe(symbols, args[1])->exec_args, branch_fds[0][IN]);
+            launch_chain(symbols, line, &find_pipe(symbols, args[2])->exec_args, branch_fds[1][IN]);
+
+            return;
+        }
+
+        int fd[2] = { -1, -1 };
+        if (i < stages->size - 1 && !make_pipe(fd)) {
+            break;
+        }
+
+        pid_t pid = spawn_stage(args, in_fd, fd[OUT]);
+        if (pid != -1) {
+            add_pid(line, pid, args[0]);
+        }
+
+        if (in_fd != -1) {
+            close(in_fd);
+        }
+        if (fd[OUT] != -1) {
+            close(fd[OUT]);
+        }
+        in_fd = fd[IN];
+    }
+
+    //only left open if the chain was cut short
+    if (in_fd != -1) {
+        close(in_fd);
+    }
+}
+
+void launch_line(symtab *symbols, exec_line *line) {
+    line->pid_count = 0;
+    line->running = 0;
+
+    launch_chain(symbols, line, line->stages, -1);
+}
+
+stage_profile *find_profile(v_line *lines, size_t first, size_t last, pid_t pid) {
+    for (size_t i = first; i < last; i++) {
+        exec_line *line = lines->storage[i];
+
+        for (size_t j = 0; j < line->pid_count; j++) {
+            if (line->pids[j] == pid) {
+                return line->profiles[j];
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * keeps up to jobs lines running at once, a line takes its slot until its last stage is reaped,
+ * with a single job it's the old line after line execution
+ */
+bool run_lines(symtab *symbols, v_line *lines, size_t jobs) {
+    size_t next = 0;
+    //lines before this one are all done
+    size_t first_active = 0;
+    size_t active = 0;
+
+    while (next < lines->size || active > 0) {
+        while (active < jobs && next < lines->size) {
+            exec_line *line = lines->storage[next++];
+
+            launch_line(symbols, line);
+            if (line->running > 0) {
+                active++;
+            }
+        }
+
+        if (active == 0) {
+            continue;
+        }
+
+        pid_t pid = -1;
+
+        //an exited stage keeps its counters until reaped, the profiler gets a last look at them first
+        if (stage_profiler) {
+            siginfo_t info;
+            if (waitid(P_ALL, 0, &info, WEXITED | WNOWAIT) == -1) {
+                perror("waitid");
+                return false;
+            }
+            pid = info.si_pid;
+        }
+
+        int wstatus;
+        struct rusage usage;
+        stage_profile *profile = NULL;
+
+        if (stage_profiler) {
+            profile = find_profile(lines, first_active, next, pid);
+            if (profile) {
+                profiler_last_sample(stage_profiler, profile);
+            }
+        }
+
+        pid = wait4(pid, &wstatus, 0, &usage);
+        if (pid == -1) {
+            perror("wait");
+            return false;
+        }
+
+        if (profile) {
+            profiler_reaped(stage_profiler, profile, &usage);
+        }
+
+        int exit_status;
+        if (WIFEXITED(wstatus) && (exit_status = WEXITSTATUS(wstatus)) != 0) {
+            fprintf(stderr, "MISSION ABORT, SOME PROCESS RETURNED NONZERO CODE: %d\n", exit_status);
+            raise(SIGTERM);
+        }
+
+        bool found = false;
+        for (size_t i = first_active; i < next && !found; i++) {
+            exec_line *line = lines->storage[i];
+
+            for (size_t j = 0; j < line->pid_count && !found; j++) {
+                if (line->pids[j] == pid) {
+                    line->pids[j] = -1;
+                    found = true;
+
+                    if (--line->running == 0) {
+                        active--;
+                    }
+                }
+            }
+        }
+
+        while (first_active < next && ((exec_line *)lines->storage[first_active])->running == 0) {
+            first_active++;
+        }
+    }
+
+    return true;
 }
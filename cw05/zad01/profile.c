@@ -0,0 +1,173 @@
+#include "profile.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static double seconds_between(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static double timeval_seconds(const struct timeval *tv) {
+    return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+static bool read_wchar(pid_t pid, uint64_t *wchar) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/io", pid);
+
+    FILE *io = fopen(path, "r");
+    if (!io) {
+        return false;
+    }
+
+    unsigned long long value;
+    bool found = fscanf(io, "rchar: %*u wchar: %llu", &value) == 1;
+    fclose(io);
+
+    if (found) {
+        *wchar = value;
+    }
+    return found;
+}
+
+//called with the mutex held
+static void sample(stage_profile *stage) {
+    uint64_t wchar;
+    if (!read_wchar(stage->pid, &wchar)) {
+        return;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    double interval = seconds_between(&stage->sampled, &now);
+    if (interval > 0 && wchar > stage->bytes_out) {
+        double rate = (wchar - stage->bytes_out) / interval;
+        if (rate > stage->peak_rate) {
+            stage->peak_rate = rate;
+        }
+    }
+
+    stage->bytes_out = wchar;
+    stage->sampled = now;
+}
+
+static void *sampler_loop(void *arg) {
+    profiler *p = arg;
+
+    while (!atomic_load(&p->stop)) {
+        pthread_mutex_lock(&p->mutex);
+        for (size_t i = 0; i < p->count; i++) {
+            if (!p->stages[i]->done) {
+                sample(p->stages[i]);
+            }
+        }
+        pthread_mutex_unlock(&p->mutex);
+
+        usleep(p->interval_ms * 1000);
+    }
+
+    return NULL;
+}
+
+void profiler_start(profiler *p, unsigned interval_ms) {
+    p->stages = NULL;
+    p->count = 0;
+    p->capacity = 0;
+    p->interval_ms = interval_ms;
+
+    pthread_mutex_init(&p->mutex, NULL);
+    atomic_init(&p->stop, false);
+    pthread_create(&p->thread, NULL, sampler_loop, p);
+}
+
+stage_profile *profiler_add(profiler *p, ssize_t line_no, size_t stage, const char *command, pid_t pid) {
+    stage_profile *profile = calloc(1, sizeof(*profile));
+    profile->line_no = line_no;
+    profile->stage = stage;
+    profile->command = command;
+    profile->pid = pid;
+    clock_gettime(CLOCK_MONOTONIC, &profile->started);
+    profile->sampled = profile->started;
+
+    pthread_mutex_lock(&p->mutex);
+    if (p->count == p->capacity) {
+        p->capacity = p->capacity == 0 ? 64 : 2 * p->capacity;
+        p->stages = reallocarray(p->stages, p->capacity, sizeof(*p->stages));
+    }
+    p->stages[p->count++] = profile;
+    pthread_mutex_unlock(&p->mutex);
+
+    return profile;
+}
+
+void profiler_last_sample(profiler *p, stage_profile *stage) {
+    pthread_mutex_lock(&p->mutex);
+    sample(stage);
+    pthread_mutex_unlock(&p->mutex);
+}
+
+void profiler_reaped(profiler *p, stage_profile *stage, const struct rusage *usage) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    pthread_mutex_lock(&p->mutex);
+    stage->wall = seconds_between(&stage->started, &now);
+    stage->usage = *usage;
+    stage->done = true;
+    pthread_mutex_unlock(&p->mutex);
+}
+
+void profiler_stop(profiler *p) {
+    atomic_store(&p->stop, true);
+    pthread_join(p->thread, NULL);
+}
+
+/**
+ * one row per stage in launch order, the stage burning the most cpu in its line is starred,
+ * that's where a slow chain is usually stuck
+ */
+void profiler_report(profiler *p, FILE *out) {
+    fprintf(out, "%6s %5s %-16s %8s %9s %9s %9s %9s %8s %8s %12s %10s %10s\n",
+            "line", "stage", "command", "pid", "wall[s]", "user[s]", "sys[s]", "rss[KB]",
+            "vol_cs", "invol_cs", "out[B]", "avg[MB/s]", "peak[MB/s]");
+
+    for (size_t first = 0; first < p->count;) {
+        //stages of one line were added together
+        size_t last = first;
+        size_t busiest = first;
+        double busiest_cpu = -1;
+
+        for (; last < p->count && p->stages[last]->line_no == p->stages[first]->line_no; last++) {
+            stage_profile *s = p->stages[last];
+            double cpu = timeval_seconds(&s->usage.ru_utime) + timeval_seconds(&s->usage.ru_stime);
+
+            if (cpu > busiest_cpu) {
+                busiest_cpu = cpu;
+                busiest = last;
+            }
+        }
+
+        for (size_t i = first; i < last; i++) {
+            stage_profile *s = p->stages[i];
+
+            fprintf(out, "%6zd %5zu %c%-15.15s %8d %9.3f %9.3f %9.3f %9ld %8ld %8ld %12llu %10.2f %10.2f\n",
+                    s->line_no, s->stage, i == busiest ? '*' : ' ', s->command, s->pid, s->wall,
+                    timeval_seconds(&s->usage.ru_utime), timeval_seconds(&s->usage.ru_stime),
+                    s->usage.ru_maxrss, s->usage.ru_nvcsw, s->usage.ru_nivcsw,
+                    (unsigned long long)s->bytes_out,
+                    s->wall > 0 ? s->bytes_out / s->wall / 1e6 : 0.0, s->peak_rate / 1e6);
+        }
+
+        first = last;
+    }
+}
+
+void profiler_free(profiler *p) {
+    for (size_t i = 0; i < p->count; i++) {
+        free(p->stages[i]);
+    }
+
+    free(p->stages);
+    pthread_mutex_destroy(&p->mutex);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+typedef struct {
+    ssize_t line_no;
+    //position in its line, fan-out branches continue the numbering
+    size_t stage;
+    const char *command;
+    pid_t pid;
+    struct timespec started;
+    //seconds from spawn to reaping
+    double wall;
+    struct rusage usage;
+    bool done;
+
+    //bytes the stage wrote (wchar of /proc/<pid>/io), for a stage that's all it puts into its pipe,
+    //a fan-out shows 0 as tee and splice aren't counted there
+    uint64_t bytes_out;
+    struct timespec sampled;
+    //highest bytes/s seen between two samples
+    double peak_rate;
+} stage_profile;
+
+/**
+ * a thread samples the output of every running stage, rusage comes from wait4 on reaping
+ */
+typedef struct {
+    stage_profile **stages;
+    size_t count;
+    size_t capacity;
+    unsigned interval_ms;
+
+    pthread_mutex_t mutex;
+    pthread_t thread;
+    atomic_bool stop;
+} profiler;
+
+void profiler_start(profiler *p, unsigned interval_ms);
+stage_profile *profiler_add(profiler *p, ssize_t line_no, size_t stage, const char *command, pid_t pid);
+//the stage has exited but isn't reaped yet, so its counters can still be read
+void profiler_last_sample(profiler *p, stage_profile *stage);
+void profiler_reaped(profiler *p, stage_profile *stage, const struct rusage *usage);
+void profiler_stop(profiler *p);
+void profiler_report(profiler *p, FILE *out);
+void profiler_free(profiler *p);
@@ -0,0 +1,83 @@
+#include "symtab.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_CAPACITY 64
+
+//FNV-1a
+static uint64_t hash_string(const char *s) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (; *s; s++) {
+        hash = (hash ^ (unsigned char)*s) * 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+void symtab_init(symtab *t) {
+    t->entries = NULL;
+    t->capacity = 0;
+    t->size = 0;
+}
+
+void symtab_free(symtab *t) {
+    free(t->entries);
+    symtab_init(t);
+}
+
+//capacity is a power of two, so the mask is the modulo
+static symtab_entry *find_slot(symtab_entry *entries, size_t capacity, const char *key, uint64_t hash) {
+    size_t idx = hash & (capacity - 1);
+
+    while (entries[idx].key && (entries[idx].hash != hash || strcmp(entries[idx].key, key) != 0)) {
+        idx = (idx + 1) & (capacity - 1);
+    }
+
+    return &entries[idx];
+}
+
+void *symtab_get(const symtab *t, const char *key) {
+    if (t->size == 0) {
+        return NULL;
+    }
+
+    symtab_entry *entry = find_slot(t->entries, t->capacity, key, hash_string(key));
+    return entry->key ? entry->value : NULL;
+}
+
+static void grow(symtab *t) {
+    size_t capacity = t->capacity == 0 ? INITIAL_CAPACITY : 2 * t->capacity;
+    symtab_entry *entries = calloc(capacity, sizeof(*entries));
+
+    for (size_t i = 0; i < t->capacity; i++) {
+        if (t->entries[i].key) {
+            *find_slot(entries, capacity, t->entries[i].key, t->entries[i].hash) = t->entries[i];
+        }
+    }
+
+    free(t->entries);
+    t->entries = entries;
+    t->capacity = capacity;
+}
+
+void *symtab_put(symtab *t, const char *key, void *value) {
+    //at most half full, probes stay short
+    if (2 * (t->size + 1) > t->capacity) {
+        grow(t);
+    }
+
+    uint64_t hash = hash_string(key);
+    symtab_entry *entry = find_slot(t->entries, t->capacity, key, hash);
+
+    void *replaced = entry->key ? entry->value : NULL;
+    if (!entry->key) {
+        t->size++;
+    }
+
+    entry->key = key;
+    entry->hash = hash;
+    entry->value = value;
+
+    return replaced;
+}
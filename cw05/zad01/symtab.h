@@ -0,0 +1,27 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    //NULL marks an empty slot
+    const char *key;
+    uint64_t hash;
+    void *value;
+} symtab_entry;
+
+/**
+ * open addressing string -> pointer map with linear probing,
+ * keys aren't copied, they have to outlive the table
+ */
+typedef struct {
+    symtab_entry *entries;
+    size_t capacity;
+    size_t size;
+} symtab;
+
+void symtab_init(symtab *t);
+void symtab_free(symtab *t);
+
+void *symtab_get(const symtab *t, const char *key);
+//returns the value it replaced, NULL if the key is new
+void *symtab_put(symtab *t, const char *key, void *value);
@@ -0,0 +1,239 @@
+#define _GNU_SOURCE //enable statx
+
+#include "listing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+//getdents64 fills this much per call, a few thousand entries
+#define DENTS_BUFFER (1024 * 1024)
+//fewer entries than this per thread aren't worth starting one
+#define MIN_ENTRIES_PER_THREAD 4096
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+
+//what the kernel fills the buffer with, see man getdents
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+bool dir_stream_open(dir_stream *s, int dir_fd) {
+    //a fresh description, getdents64 moves its offset
+    s->fd = openat(dir_fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (s->fd == -1) {
+        perror("open");
+        return false;
+    }
+
+    s->buffer = malloc(DENTS_BUFFER);
+    s->size = 0;
+    s->pos = 0;
+
+    return true;
+}
+
+const char *dir_stream_next(dir_stream *s, bool *failed) {
+    if (s->pos == s->size) {
+        long n = syscall(SYS_getdents64, s->fd, s->buffer, DENTS_BUFFER);
+        if (n == -1) {
+            perror("getdents64");
+            *failed = true;
+        }
+        if (n <= 0) {
+            return NULL;
+        }
+
+        s->size = n;
+        s->pos = 0;
+    }
+
+    struct linux_dirent64 *dent = (struct linux_dirent64 *)(s->buffer + s->pos);
+    s->pos += dent->d_reclen;
+
+    return dent->d_name;
+}
+
+void dir_stream_close(dir_stream *s) {
+    free(s->buffer);
+    close(s->fd);
+}
+
+bool entry_key(int dir_fd, const char *name, listing_key key, uint64_t *value) {
+    struct statx stx;
+
+    //ls -l doesn't follow symlinks either
+    if (statx(dir_fd, name, AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC,
+              key == KEY_MTIME ? STATX_MTIME : STATX_SIZE, &stx) == -1) {
+        perror(name);
+        return false;
+    }
+
+    if (key == KEY_MTIME) {
+        //nanoseconds since the epoch fit an int64 until 2262, flipping the sign bit orders them as unsigned
+        int64_t ns = stx.stx_mtime.tv_sec * 1000000000LL + stx.stx_mtime.tv_nsec;
+        *value = ~((uint64_t)ns ^ (1ULL << 63));
+    }
+    else {
+        *value = ~stx.stx_size;
+    }
+
+    return true;
+}
+
+bool listing_read(dir_listing *l, int dir_fd) {
+    l->names = NULL;
+    l->names_size = 0;
+    l->names_capacity = 0;
+    l->records = NULL;
+    l->count = 0;
+    l->capacity = 0;
+
+    dir_stream s;
+    if (!dir_stream_open(&s, dir_fd)) {
+        return false;
+    }
+
+    bool failed = false;
+    const char *name;
+    while ((name = dir_stream_next(&s, &failed))) {
+        size_t len = strlen(name) + 1;
+
+        if (l->names_size + len > l->names_capacity) {
+            l->names_capacity = l->names_capacity == 0 ? 64 * 1024 : 2 * l->names_capacity;
+            l->names = realloc(l->names, l->names_capacity);
+        }
+        if (l->count == l->capacity) {
+            l->capacity = l->capacity == 0 ? 1024 : 2 * l->capacity;
+            l->records = reallocarray(l->records, l->capacity, sizeof(*l->records));
+        }
+
+        l->records[l->count++] = (listing_record){ .key = 0, .name = l->names_size };
+        memcpy(l->names + l->names_size, name, len);
+        l->names_size += len;
+    }
+
+    dir_stream_close(&s);
+    return !failed;
+}
+
+typedef struct {
+    dir_listing *listing;
+    int dir_fd;
+    listing_key key;
+    size_t begin;
+    size_t end;
+    bool failed;
+} stat_range;
+
+static void *stat_entries(void *arg) {
+    stat_range *range = arg;
+    dir_listing *l = range->listing;
+
+    for (size_t i = range->begin; i < range->end; i++) {
+        if (!entry_key(range->dir_fd, listing_name(l, i), range->key, &l->records[i].key)) {
+            //gone meanwhile, listed last
+            l->records[i].key = UINT64_MAX;
+            range->failed = true;
+        }
+    }
+
+    return NULL;
+}
+
+bool listing_stat(dir_listing *l, int dir_fd, listing_key key, size_t thread_count) {
+    size_t most_useful = l->count / MIN_ENTRIES_PER_THREAD + 1;
+    if (thread_count > most_useful) {
+        thread_count = most_useful;
+    }
+
+    //every thread takes a contiguous range of records, the last one is ours
+    stat_range *ranges = calloc(thread_count, sizeof(*ranges));
+    pthread_t *threads = calloc(thread_count, sizeof(*threads));
+
+    for (size_t i = 0; i < thread_count; i++) {
+        ranges[i] = (stat_range){
+            .listing = l,
+            .dir_fd = dir_fd,
+            .key = key,
+            .begin = l->count * i / thread_count,
+            .end = l->count * (i + 1) / thread_count
+        };
+
+        if (i < thread_count - 1) {
+            pthread_create(&threads[i], NULL, stat_entries, &ranges[i]);
+        }
+    }
+
+    stat_entries(&ranges[thread_count - 1]);
+
+    bool failed = ranges[thread_count - 1].failed;
+    for (size_t i = 0; i < thread_count - 1; i++) {
+        pthread_join(threads[i], NULL);
+        failed |= ranges[i].failed;
+    }
+
+    free(threads);
+    free(ranges);
+
+    return !failed;
+}
+
+/**
+ * lsd radix sort a byte at a time, bytes every key shares are skipped,
+ * times cluster so usually only half of them are left
+ */
+void listing_sort(dir_listing *l) {
+    if (l->count < 2) {
+        return;
+    }
+
+    listing_record *from = l->records;
+    listing_record *to = malloc(l->count * sizeof(*to));
+
+    size_t counts[sizeof(uint64_t)][RADIX_BUCKETS] = { { 0 } };
+    for (size_t i = 0; i < l->count; i++) {
+        for (size_t b = 0; b < sizeof(uint64_t); b++) {
+            counts[b][(from[i].key >> (b * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+        }
+    }
+
+    for (size_t b = 0; b < sizeof(uint64_t); b++) {
+        size_t shift = b * RADIX_BITS;
+
+        if (counts[b][(from[0].key >> shift) & (RADIX_BUCKETS - 1)] == l->count) {
+            continue;
+        }
+
+        size_t offsets[RADIX_BUCKETS];
+        size_t offset = 0;
+        for (size_t d = 0; d < RADIX_BUCKETS; d++) {
+            offsets[d] = offset;
+            offset += counts[b][d];
+        }
+
+        for (size_t i = 0; i < l->count; i++) {
+            to[offsets[(from[i].key >> shift) & (RADIX_BUCKETS - 1)]++] = from[i];
+        }
+
+        listing_record *tmp = from;
+        from = to;
+        to = tmp;
+    }
+
+    l->records = from;
+    free(to);
+}
+
+void listing_free(dir_listing *l) {
+    free(l->names);
+    free(l->records);
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    KEY_MTIME,
+    KEY_SIZE
+} listing_key;
+
+//what gets sorted, the name lives in the listing's name arena
+typedef struct {
+    uint64_t key;
+    uint32_t name;
+} listing_record;
+
+typedef struct {
+    //every name NUL-terminated, back to back
+    char *names;
+    size_t names_size;
+    size_t names_capacity;
+
+    listing_record *records;
+    size_t count;
+    size_t capacity;
+} dir_listing;
+
+/**
+ * reads a directory getdents64 buffer by buffer, names are valid until the next call
+ */
+typedef struct {
+    int fd;
+    char *buffer;
+    size_t size;
+    size_t pos;
+} dir_stream;
+
+bool dir_stream_open(dir_stream *s, int dir_fd);
+//NULL at the end of the directory or on an error, which is reported
+const char *dir_stream_next(dir_stream *s, bool *failed);
+void dir_stream_close(dir_stream *s);
+
+//the key orders the newest or the largest first as a plain unsigned ascending sort
+bool entry_key(int dir_fd, const char *name, listing_key key, uint64_t *value);
+
+bool listing_read(dir_listing *l, int dir_fd);
+//statx of every entry, spread over threads
+bool listing_stat(dir_listing *l, int dir_fd, listing_key key, size_t thread_count);
+//stable, so equal keys stay in directory order
+void listing_sort(dir_listing *l);
+void listing_free(dir_listing *l);
+
+static inline const char *listing_name(const dir_listing *l, size_t i) {
+    return l->names + l->records[i].name;
+}
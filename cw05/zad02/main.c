@@ -1,150 +1,125 @@
-#define _GNU_SOURCE
+#define _GNU_SOURCE //enable getopt_long
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
 
-#include "ptr_vector.h"
+#include "listing.h"
+#include "topk.h"
 
-typedef struct {
-    char *filename;
-    char *date;
-} pair_date;
+bool list_top(int dir_fd, listing_key key, size_t k);
 
-typedef struct {
-    char *filename;
-    size_t size;
-} pair_size;
-
-const char *SEP = " \f\n\r\t\v";
-
-int pair_date_cmp(const void *p1, const void *p2) {
-    pair_date * const *pair1 = p1;
-    pair_date * const *pair2 = p2;
-
-    return strcmp((*pair2)->date, (*pair1)->date);
-}
-
-int pair_size_cmp(const void *p1, const void *p2) {
-    pair_size * const *pair1 = p1;
-    pair_size * const *pair2 = p2;
-
-    return (*pair2)->size - (*pair1)->size;
-}
-
-pair_date *extract_w_date(char *line) {
-    pair_date *result = malloc(sizeof(*result));
-
-    char *tok = strtok(line, SEP);
-    for (size_t i = 0; i < 5; i++) {
-        tok = strtok(NULL, SEP);
-    }
-
-    char *date = strdup(tok);
-    tok = strtok(NULL, SEP);
-    char *time = strdup(tok);
-    tok = strtok(NULL, SEP);
-
-    asprintf(&result->date, "%s %s", date, time);
-    free(date);
-    free(time);
-
-    result->filename = strdup(tok);
-    return result;
-};
-
-pair_size *extract_w_size(char *line) {
-    pair_size *result = malloc(sizeof(*result));
-
-    char *tok = strtok(line, SEP);
-    for (size_t i = 0; i < 4; i++) {
-        tok = strtok(NULL, SEP);
-    }
-
-    sscanf(tok, "%zu", &result->size);
-
-    for (size_t i = 0; i < 3; i++) {
-        tok = strtok(NULL, SEP);
+int main(int argc, char **argv) {
+    long thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+    //0 lists everything
+    size_t top = 0;
+
+    struct option long_options[] = {
+        { "top", required_argument, NULL, 'k' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "t:k:", long_options, NULL)) != -1) {
+        //%zu would take a leading '-' and wrap it around
+        if (opt == 'k' && optarg[strspn(optarg, " \t")] != '-' && sscanf(optarg, "%zu", &top) == 1 && top > 0) {
+            continue;
+        }
+        else if (opt != 't' || sscanf(optarg, "%ld", &thread_count) != 1 || thread_count < 1) {
+            fprintf(stderr, "usage: %s [-t threads] [--top k] date|size\n", argv[0]);
+            return EXIT_FAILURE;
+        }
     }
 
-    result->filename = strdup(tok);
-    return result;
-}
+    //from now on argv[1] is the sort key
+    argc -= optind - 1;
+    argv += optind - 1;
 
-int main(int argc, char **argv) {
     if (argc != 2) {
         fprintf(stderr, "invalid argument count\n");
         return EXIT_FAILURE;
     }
 
-    bool date;
+    listing_key key;
     if (strcmp("date", argv[1]) == 0) {
-        date = true;
+        key = KEY_MTIME;
     }
     else if (strcmp("size", argv[1]) == 0) {
-        date = false;
+        key = KEY_SIZE;
     }
     else {
         fprintf(stderr, "malformed arguments\n");
         return EXIT_FAILURE;
     }
 
-    FILE *pipe = popen("ls -la --time-style=long-iso", "r");
-    if (!pipe) {
-        perror("pipe");
+    //the working directory, newest or largest first like ls -la would list it sorted
+    int dir_fd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd == -1) {
+        perror(".");
         return EXIT_FAILURE;
     }
 
-    ptr_vector pairs;
-    vec_init(&pairs);
-
-    bool first = true;
-    char *line = NULL;
-    size_t n = 0;
-    while (getline(&line, &n, pipe) > 0) {
-        if (first) {
-            first = false;
-            continue;
-        }
+    if (top > 0) {
+        bool listed = list_top(dir_fd, key, top);
+        close(dir_fd);
 
-        vec_push_back(&pairs, date ? extract_w_date(line) : extract_w_size(line));
+        return listed ? EXIT_SUCCESS : EXIT_FAILURE;
     }
 
-    free(line);
+    dir_listing listing;
+    bool listed = listing_read(&listing, dir_fd) && listing_stat(&listing, dir_fd, key, thread_count);
 
-    if (date) {
-        qsort(pairs.storage, pairs.size, sizeof(*pairs.storage), pair_date_cmp);
+    listing_sort(&listing);
 
-        for (size_t i = 0; i < pairs.size; i++) {
-            pair_date *pair = pairs.storage[i];
-            puts(pair->filename);
-        }
+    for (size_t i = 0; i < listing.count; i++) {
+        puts(listing_name(&listing, i));
+    }
 
-        while (pairs.size > 0) {
-            pair_date *pair = vec_pop_back(&pairs);
+    listing_free(&listing);
+    close(dir_fd);
 
-            free(pair->filename);
-            free(pair->date);
-            free(pair);
-        }
+    return listed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * streams the directory through a heap of the k best so far,
+ * nothing but them is kept and a name is copied only when its entry gets in
+ */
+bool list_top(int dir_fd, listing_key key, size_t k) {
+    dir_stream s;
+    if (!dir_stream_open(&s, dir_fd)) {
+        return false;
     }
-    else {
-        qsort(pairs.storage, pairs.size, sizeof(*pairs.storage), pair_size_cmp);
 
-        for (size_t i = 0; i < pairs.size; i++) {
-            pair_size *pair = pairs.storage[i];
-            puts(pair->filename);
-        }
+    topk best;
+    topk_init(&best, k);
 
-        while (pairs.size > 0) {
-            pair_size *pair = vec_pop_back(&pairs);
+    bool failed = false;
+    const char *name;
+    while ((name = dir_stream_next(&s, &failed))) {
+        uint64_t value;
 
-            free(pair->filename);
-            free(pair);
+        if (!entry_key(dir_fd, name, key, &value)) {
+            failed = true;
+        }
+        else if (!topk_offer(&best, value, name)) {
+            perror("top");
+            failed = true;
+            break;
         }
     }
 
-    vec_clear(&pairs);
-    pclose(pipe);
-}
\ No newline at end of file
+    dir_stream_close(&s);
+
+    topk_sort(&best);
+    for (size_t i = 0; i < best.size; i++) {
+        puts(best.heap[i].name);
+    }
+
+    topk_free(&best);
+    return !failed;
+}
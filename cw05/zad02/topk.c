@@ -0,0 +1,106 @@
+#include "topk.h"
+#include <stdlib.h>
+#include <string.h>
+
+static bool worse(const topk_entry *a, const topk_entry *b) {
+    return a->key != b->key ? a->key > b->key : a->seq > b->seq;
+}
+
+static void swap(topk_entry *a, topk_entry *b) {
+    topk_entry tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+static void sift_up(topk *t, size_t i) {
+    while (i > 0 && worse(&t->heap[i], &t->heap[(i - 1) / 2])) {
+        swap(&t->heap[i], &t->heap[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+}
+
+static void sift_down(topk *t, size_t i) {
+    while (true) {
+        size_t worst = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+
+        if (left < t->size && worse(&t->heap[left], &t->heap[worst])) {
+            worst = left;
+        }
+        if (right < t->size && worse(&t->heap[right], &t->heap[worst])) {
+            worst = right;
+        }
+        if (worst == i) {
+            return;
+        }
+
+        swap(&t->heap[i], &t->heap[worst]);
+        i = worst;
+    }
+}
+
+void topk_init(topk *t, size_t k) {
+    //grown as entries come, a k beyond the directory size costs nothing
+    t->heap = NULL;
+    t->capacity = 0;
+    t->size = 0;
+    t->k = k;
+    t->seen = 0;
+}
+
+bool topk_offer(topk *t, uint64_t key, const char *name) {
+    topk_entry entry = { .key = key, .seq = t->seen++, .name = NULL };
+
+    if (t->size < t->k) {
+        if (t->size == t->capacity) {
+            size_t capacity = t->capacity == 0 ? 64 : 2 * t->capacity;
+            if (capacity > t->k) {
+                capacity = t->k;
+            }
+
+            topk_entry *heap = reallocarray(t->heap, capacity, sizeof(*heap));
+            if (!heap) {
+                return false;
+            }
+            t->heap = heap;
+            t->capacity = capacity;
+        }
+
+        entry.name = strdup(name);
+        t->heap[t->size++] = entry;
+        sift_up(t, t->size - 1);
+        return true;
+    }
+
+    //a later entry with the same key loses, it would come after in the full sort
+    if (!worse(&t->heap[0], &entry)) {
+        return true;
+    }
+
+    free(t->heap[0].name);
+    entry.name = strdup(name);
+    t->heap[0] = entry;
+    sift_down(t, 0);
+    return true;
+}
+
+void topk_sort(topk *t) {
+    size_t count = t->size;
+
+    //heapsort in place, the worst left at the root goes right behind the heap
+    while (t->size > 1) {
+        swap(&t->heap[0], &t->heap[--t->size]);
+        sift_down(t, 0);
+    }
+
+    t->size = count;
+}
+
+void topk_free(topk *t) {
+    for (size_t i = 0; i < t->size; i++) {
+        free(t->heap[i].name);
+    }
+
+    free(t->heap);
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+    uint64_t key;
+    //directory order, ties keep it just like the stable full sort
+    uint64_t seq;
+    char *name;
+} topk_entry;
+
+/**
+ * the k smallest keys seen so far, a max-heap so the one to beat is at the root,
+ * names are copied only once an entry makes it in
+ */
+typedef struct {
+    topk_entry *heap;
+    size_t capacity;
+    size_t size;
+    size_t k;
+    uint64_t seen;
+} topk;
+
+void topk_init(topk *t, size_t k);
+//false when the heap can't grow
+bool topk_offer(topk *t, uint64_t key, const char *name);
+//orders heap smallest key first, no more offers after that
+void topk_sort(topk *t);
+void topk_free(topk *t);
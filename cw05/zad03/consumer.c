@@ -1,8 +1,28 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
 #include <sys/file.h>
 
+#include "ring.h"
+
 int main(int argc, char **argv) {
+    //with -r the source is a shared memory ring instead of a fifo
+    bool use_ring = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r")) != -1) {
+        if (opt != 'r') {
+            fprintf(stderr, "usage: %s [-r] source target N\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        use_ring = true;
+    }
+
+    //from now on argv[1] is the source
+    argc -= optind - 1;
+    argv += optind - 1;
+
     if (argc != 4) {
         fprintf(stderr, "invalid argument count\n");
         return EXIT_FAILURE;
@@ -14,9 +34,23 @@ int main(int argc, char **argv) {
         return EXIT_FAILURE;
     }
 
-    FILE *source = fopen(argv[1], "r");
-    if (!source) {
-        perror(argv[1]);
+    FILE *source = NULL;
+    ring *r = NULL;
+
+    if (use_ring) {
+        r = ring_open(argv[1]);
+    }
+    else {
+        source = fopen(argv[1], "r");
+        if (source) {
+            setbuf(source, NULL);
+        }
+        else {
+            perror(argv[1]);
+        }
+    }
+
+    if (!source && !r) {
         return EXIT_FAILURE;
     }
 
@@ -26,14 +60,13 @@ int main(int argc, char **argv) {
         return EXIT_FAILURE;
     }
 
-    setbuf(source, NULL);
     setbuf(target, NULL);
 
     short line_no;
     size_t total_buf_size = sizeof(line_no) + chars_per_read;
     char *buf = malloc(total_buf_size);
 
-    while (fread(buf, 1, total_buf_size, source) == total_buf_size) {
+    while (r ? ring_pop(r, buf) : fread(buf, 1, total_buf_size, source) == total_buf_size) {
         line_no = *(short*)buf;
         char *payload = buf + sizeof(line_no);
 
@@ -81,6 +114,12 @@ int main(int argc, char **argv) {
     }
 
     free(buf);
-    fclose(source);
     fclose(target);
+
+    if (r) {
+        ring_close(r);
+    }
+    else {
+        fclose(source);
+    }
 }
@@ -1,10 +1,30 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <time.h>
+#include <unistd.h>
+
+#include "ring.h"
 
 struct timespec rem;
 
 int main(int argc, char **argv) {
+    //with -r the target is a shared memory ring instead of a fifo
+    bool use_ring = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r")) != -1) {
+        if (opt != 'r') {
+            fprintf(stderr, "usage: %s [-r] target line_no source N\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        use_ring = true;
+    }
+
+    //from now on argv[1] is the target
+    argc -= optind - 1;
+    argv += optind - 1;
+
     if (argc != 5) {
         fprintf(stderr, "invalid argument count\n");
         return EXIT_FAILURE;
@@ -24,14 +44,27 @@ int main(int argc, char **argv) {
         return EXIT_FAILURE;
     }
 
-    FILE *target = fopen(argv[1], "w");
-    if (!target) {
-        perror(argv[1]);
+    FILE *target = NULL;
+    ring *r = NULL;
+
+    if (use_ring) {
+        r = ring_open(argv[1]);
+    }
+    else {
+        target = fopen(argv[1], "w");
+        if (target) {
+            setbuf(target, NULL);
+        }
+        else {
+            perror(argv[1]);
+        }
+    }
+
+    if (!target && !r) {
         return EXIT_FAILURE;
     }
 
     setbuf(source, NULL);
-    setbuf(target, NULL);
 
     size_t total_buf_size = sizeof(line_no) + chars_per_read;
     char *buf = malloc(total_buf_size);
@@ -45,7 +78,11 @@ int main(int argc, char **argv) {
 
         nanosleep(&sleep_time, &rem);
 
-        if (fwrite(buf, 1, total_buf_size, target) != total_buf_size) {
+        //a slot holds a whole record, no PIPE_BUF limit and no syscall unless the ring is full
+        if (r) {
+            ring_push(r, buf);
+        }
+        else if (fwrite(buf, 1, total_buf_size, target) != total_buf_size) {
             perror(argv[1]);
             return EXIT_FAILURE;
         }
@@ -53,5 +90,12 @@ int main(int argc, char **argv) {
 
     free(buf);
     fclose(source);
-    fclose(target);
+
+    if (r) {
+        ring_producer_done(r);
+        ring_close(r);
+    }
+    else {
+        fclose(target);
+    }
 }
@@ -0,0 +1,225 @@
+#include "ring.h"
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+typedef struct {
+    _Atomic uint64_t seq;
+    unsigned char record[];
+} ring_slot;
+
+static long futex(_Atomic uint32_t *addr, int op, uint32_t val) {
+    //not FUTEX_PRIVATE_FLAG, the word is shared between processes
+    return syscall(SYS_futex, addr, op, val, NULL, NULL, 0);
+}
+
+static size_t ring_size(size_t slot_count, size_t slot_stride) {
+    return sizeof(ring) + slot_count * slot_stride;
+}
+
+static ring_slot *slot_at(ring *r, uint64_t pos) {
+    //slot_count is a power of two
+    return (ring_slot *)(r->slots + (pos & (r->slot_count - 1)) * r->slot_stride);
+}
+
+ring *ring_create(const char *name, size_t slot_count, size_t record_size, size_t producers) {
+    //rounded up, so positions map to slots with a mask
+    size_t count = 1;
+    while (count < slot_count) {
+        count *= 2;
+    }
+
+    size_t stride = (sizeof(ring_slot) + record_size + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+    size_t size = ring_size(count, stride);
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd == -1) {
+        perror(name);
+        return NULL;
+    }
+
+    if (ftruncate(fd, size) == -1) {
+        perror(name);
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+
+    ring *r = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (r == MAP_FAILED) {
+        perror(name);
+        shm_unlink(name);
+        return NULL;
+    }
+
+    //everything else starts as the zeros of a fresh shm object
+    r->slot_count = count;
+    r->record_size = record_size;
+    r->slot_stride = stride;
+    atomic_store(&r->producers, producers);
+
+    //slot i is free for the producer at position i
+    for (size_t i = 0; i < count; i++) {
+        atomic_store_explicit(&slot_at(r, i)->seq, i, memory_order_relaxed);
+    }
+
+    return r;
+}
+
+ring *ring_open(const char *name) {
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd == -1) {
+        perror(name);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        perror(name);
+        close(fd);
+        return NULL;
+    }
+
+    ring *r = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (r == MAP_FAILED) {
+        perror(name);
+        return NULL;
+    }
+
+    return r;
+}
+
+void ring_close(ring *r) {
+    munmap(r, ring_size(r->slot_count, r->slot_stride));
+}
+
+static void event_post(ring_event *event, int wake) {
+    //seq_cst, either the waiter sees our slot or we see it waiting
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (atomic_load(&event->waiters)) {
+        atomic_fetch_add(&event->seq, 1);
+        futex(&event->seq, FUTEX_WAKE, wake);
+    }
+}
+
+static bool try_push(ring *r, const void *record) {
+    uint64_t pos = atomic_load_explicit(&r->enqueue_pos, memory_order_relaxed);
+
+    while (true) {
+        ring_slot *slot = slot_at(r, pos);
+        int64_t diff = (int64_t)(atomic_load_explicit(&slot->seq, memory_order_acquire) - pos);
+
+        if (diff == 0) {
+            //the slot is free, it's ours if nobody claimed the position meanwhile
+            if (atomic_compare_exchange_weak_explicit(&r->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                memcpy(slot->record, record, r->record_size);
+                atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+                return true;
+            }
+        }
+        else if (diff < 0) {
+            //still holding the record from a lap ago
+            return false;
+        }
+        else {
+            pos = atomic_load_explicit(&r->enqueue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+static bool try_pop(ring *r, void *record) {
+    uint64_t pos = atomic_load_explicit(&r->dequeue_pos, memory_order_relaxed);
+
+    while (true) {
+        ring_slot *slot = slot_at(r, pos);
+        int64_t diff = (int64_t)(atomic_load_explicit(&slot->seq, memory_order_acquire) - (pos + 1));
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&r->dequeue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                memcpy(record, slot->record, r->record_size);
+                //free for the producer one lap later
+                atomic_store_explicit(&slot->seq, pos + r->slot_count, memory_order_release);
+                return true;
+            }
+        }
+        else if (diff < 0) {
+            //not written yet
+            return false;
+        }
+        else {
+            pos = atomic_load_explicit(&r->dequeue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+void ring_push(ring *r, const void *record) {
+    while (!try_push(r, record)) {
+        atomic_fetch_add(&r->not_full.waiters, 1);
+        uint32_t seen = atomic_load(&r->not_full.seq);
+
+        //a consumer might have made room before it could see us waiting
+        if (try_push(r, record)) {
+            atomic_fetch_sub(&r->not_full.waiters, 1);
+            break;
+        }
+
+        //EAGAIN when seq moved on in between, EINTR on a signal, both just retry
+        futex(&r->not_full.seq, FUTEX_WAIT, seen);
+        atomic_fetch_sub(&r->not_full.waiters, 1);
+    }
+
+    event_post(&r->not_empty, 1);
+}
+
+bool ring_pop(ring *r, void *record) {
+    while (true) {
+        //read before trying, whatever a finished producer pushed is visible by then
+        bool finished = atomic_load(&r->producers) == 0;
+
+        if (try_pop(r, record)) {
+            break;
+        }
+        if (finished) {
+            return false;
+        }
+
+        atomic_fetch_add(&r->not_empty.waiters, 1);
+        uint32_t seen = atomic_load(&r->not_empty.seq);
+
+        //a producer might have pushed or finished before it could see us waiting
+        if (try_pop(r, record)) {
+            atomic_fetch_sub(&r->not_empty.waiters, 1);
+            break;
+        }
+        if (atomic_load(&r->producers) == 0) {
+            atomic_fetch_sub(&r->not_empty.waiters, 1);
+            continue;
+        }
+
+        futex(&r->not_empty.seq, FUTEX_WAIT, seen);
+        atomic_fetch_sub(&r->not_empty.waiters, 1);
+    }
+
+    event_post(&r->not_full, 1);
+    return true;
+}
+
+void ring_producer_done(ring *r) {
+    atomic_fetch_sub(&r->producers, 1);
+
+    //every waiting consumer has to notice there's nothing more coming
+    event_post(&r->not_empty, INT_MAX);
+}
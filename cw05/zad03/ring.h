@@ -0,0 +1,49 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+//records a ring holds before producers have to wait
+#define RING_SLOTS 64
+
+//bumped whenever the other side may have made progress, the futex sleeps on it
+typedef struct {
+    _Atomic uint32_t seq;
+    _Atomic uint32_t waiters;
+} ring_event;
+
+/**
+ * a bounded multi-producer multi-consumer queue of fixed size records in shared memory,
+ * every slot carries a sequence number telling whose turn it is (see Vyukov's bounded queue),
+ * so claiming a slot is a single cas and nothing ever takes a lock
+ * 
+ * futex is only touched when the ring is full or empty and somebody is actually waiting
+ */
+typedef struct {
+    size_t slot_count;
+    size_t record_size;
+    size_t slot_stride;
+
+    //producers that haven't finished yet, consumers stop once it's 0 and the ring is empty
+    _Alignas(64) _Atomic size_t producers;
+    ring_event not_empty;
+    ring_event not_full;
+
+    //each on its own cache line, producers and consumers don't bounce each other's
+    _Alignas(64) _Atomic uint64_t enqueue_pos;
+    _Alignas(64) _Atomic uint64_t dequeue_pos;
+
+    _Alignas(64) unsigned char slots[];
+} ring;
+
+//the creator names the ring, every producer has to call ring_producer_done eventually
+ring *ring_create(const char *name, size_t slot_count, size_t record_size, size_t producers);
+ring *ring_open(const char *name);
+void ring_close(ring *r);
+
+//blocks while the ring is full
+void ring_push(ring *r, const void *record);
+//blocks while the ring is empty, false once it's empty for good
+bool ring_pop(ring *r, void *record);
+void ring_producer_done(ring *r);
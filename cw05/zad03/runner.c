@@ -8,13 +8,43 @@
 #include <unistd.h>
 #include <signal.h>
 #include <string.h>
+#include <stdbool.h>
+#include <sys/mman.h>
+
+#include "ring.h"
+
+#define RING_NAME_SIZE 64
+
+//set once the ring exists, so it's removed however we end
+char ring_name[RING_NAME_SIZE] = "";
 
 void term_handler(int sig) {
     kill(0, SIGTERM);
+
+    if (ring_name[0]) {
+        shm_unlink(ring_name);
+    }
     _exit(EXIT_FAILURE);
 }
 
 int main(int argc, char **argv) {
+    bool use_ring = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:")) != -1) {
+        if (opt == 't' && strcmp(optarg, "ring") == 0) {
+            use_ring = true;
+        }
+        else if (opt != 't' || strcmp(optarg, "fifo") != 0) {
+            fprintf(stderr, "usage: %s [-t fifo|ring] consumer_count N file...\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    //from now on argv[1] is the consumer count
+    argc -= optind - 1;
+    argv += optind - 1;
+
     if (argc < 4) {
         fprintf(stderr, "invalid argument count\n");
         return EXIT_FAILURE;
@@ -43,12 +73,6 @@ int main(int argc, char **argv) {
     
     sigaction(SIGTERM, &act, NULL);
 
-    const char *fifo_name = tmpnam(NULL);
-    if (!fifo_name) {
-        fprintf(stderr, "can't open fifo\n");
-        return EXIT_FAILURE;
-    }
-
     char out_name[] = "/tmp/runner_outXXXXXX";
     int out_file_fd = mkstemp(out_name);
 
@@ -60,9 +84,34 @@ int main(int argc, char **argv) {
     FILE *out_file = fdopen(out_file_fd, "r");
     rewind(out_file);
 
-    if (mkfifo(fifo_name, 0666) != 0) {
-        perror("fifo");
-        return EXIT_FAILURE;
+    /**
+     * the fifo's records are only atomic up to PIPE_BUF and cost a syscall on each side,
+     * the ring takes records of any size straight from producers' to consumers' memory
+     */
+    const char *transport_name;
+    ring *r = NULL;
+
+    if (use_ring) {
+        snprintf(ring_name, sizeof(ring_name), "/cw05_zad03.%d", getpid());
+
+        r = ring_create(ring_name, RING_SLOTS, sizeof(short) + chars_per_read, argc - 3);
+        if (!r) {
+            ring_name[0] = '\0';
+            return EXIT_FAILURE;
+        }
+        transport_name = ring_name;
+    }
+    else {
+        transport_name = tmpnam(NULL);
+        if (!transport_name) {
+            fprintf(stderr, "can't open fifo\n");
+            return EXIT_FAILURE;
+        }
+
+        if (mkfifo(transport_name, 0666) != 0) {
+            perror("fifo");
+            return EXIT_FAILURE;
+        }
     }
 
     char *chars_per_read_str;
@@ -70,7 +119,12 @@ int main(int argc, char **argv) {
 
     for (size_t i = 0; i < consumer_count; i++) {
         if (fork() == 0) {
-            execl("./consumer", "./consumer", fifo_name, out_name, chars_per_read_str, NULL);
+            if (use_ring) {
+                execl("./consumer", "./consumer", "-r", transport_name, out_name, chars_per_read_str, NULL);
+            }
+            else {
+                execl("./consumer", "./consumer", transport_name, out_name, chars_per_read_str, NULL);
+            }
             return EXIT_FAILURE;
         }
     }
@@ -79,7 +133,12 @@ int main(int argc, char **argv) {
         char *line_no_str;
         asprintf(&line_no_str, "%zu", i - 3);
         if (fork() == 0) {
-            execl("./producer", "./producer", fifo_name, line_no_str, argv[i], chars_per_read_str, NULL);
+            if (use_ring) {
+                execl("./producer", "./producer", "-r", transport_name, line_no_str, argv[i], chars_per_read_str, NULL);
+            }
+            else {
+                execl("./producer", "./producer", transport_name, line_no_str, argv[i], chars_per_read_str, NULL);
+            }
             return EXIT_FAILURE;
         }
         free(line_no_str);
@@ -94,6 +153,17 @@ int main(int argc, char **argv) {
             fprintf(stderr, "MISSION ABORT, SOME PROCESS RETURNED NONZERO CODE: %d\n", exit_status);
             raise(SIGTERM);
         }
+
+        //a killed producer never says it's done, the consumers would wait on the ring forever
+        if (r && WIFSIGNALED(wstatus)) {
+            fprintf(stderr, "MISSION ABORT, SOME PROCESS WAS KILLED BY SIGNAL: %d\n", WTERMSIG(wstatus));
+            raise(SIGTERM);
+        }
+    }
+
+    if (r) {
+        ring_close(r);
+        shm_unlink(ring_name);
     }
 
     char *lineptr = NULL;